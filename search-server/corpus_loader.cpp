@@ -0,0 +1,365 @@
+#include "corpus_loader.h"
+#include "bounded_queue.h"
+#include "string_processing.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const size_t LINES_PER_BATCH = 512;
+const size_t READ_CHUNK_SIZE = 1 << 20;
+
+// Corpus file, mapped into memory when the file allows it
+class CorpusFile {
+public:
+    explicit CorpusFile(const std::string& path)
+        : path_(path)
+        , fd_(open(path.c_str(), O_RDONLY))
+    {
+        if (fd_ < 0) {
+            using namespace std::string_literals;
+            throw std::runtime_error("Cannot open corpus "s + path);
+        }
+        struct stat file_stat = {};
+        if (fstat(fd_, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+            void* mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+            if (mapping != MAP_FAILED) {
+                madvise(mapping, file_stat.st_size, MADV_SEQUENTIAL);
+                mapping_ = mapping;
+                size_ = file_stat.st_size;
+            }
+        }
+    }
+
+    CorpusFile(const CorpusFile&) = delete;
+    CorpusFile& operator=(const CorpusFile&) = delete;
+
+    ~CorpusFile() {
+        if (mapping_ != nullptr) {
+            munmap(mapping_, size_);
+        }
+        close(fd_);
+    }
+
+    bool IsMapped() const {
+        return mapping_ != nullptr;
+    }
+
+    std::string_view GetMapping() const {
+        return { static_cast<const char*>(mapping_), size_ };
+    }
+
+    // Returns 0 at the end of the file, throws on a read error
+    size_t Read(char* buffer, size_t size) {
+        while (true) {
+            const ssize_t read_size = read(fd_, buffer, size);
+            if (read_size >= 0) {
+                return static_cast<size_t>(read_size);
+            }
+            if (errno != EINTR) {
+                using namespace std::string_literals;
+                throw std::runtime_error("Cannot read corpus "s + path_ + ": "s + std::strerror(errno));
+            }
+        }
+    }
+
+private:
+    const std::string path_;
+    const int fd_;
+    void* mapping_ = nullptr;
+    size_t size_ = 0;
+};
+
+struct LineBatch {
+    // Position of the batch in the file
+    size_t index = 0;
+    // Owns the text of the lines when the file is read rather than mapped
+    std::shared_ptr<const std::string> storage;
+    // Number of every line in the file and its text
+    std::vector<std::pair<size_t, std::string_view>> lines;
+};
+
+struct DocumentBatch {
+    size_t index = 0;
+    // Number of the line every document comes from and the document
+    std::vector<std::pair<size_t, PreparedDocument>> documents;
+    // Failure on the line after the last document, raised once the
+    // indexer reaches it so errors follow the order of the file
+    std::exception_ptr error;
+};
+
+// Wraps a failure of a document so the message names its line
+std::exception_ptr AddLineNumber(size_t line_number) {
+    try {
+        throw;
+    }
+    catch (const std::invalid_argument& e) {
+        using namespace std::string_literals;
+        return std::make_exception_ptr(std::invalid_argument(
+            "Corpus line "s + std::to_string(line_number) + ": "s + e.what()));
+    }
+    catch (...) {
+        return std::current_exception();
+    }
+}
+
+// Cuts text into lines and sends the non-empty ones to the tokenizers in batches
+class LineBatcher {
+public:
+    explicit LineBatcher(BoundedQueue<LineBatch>& line_batches)
+        : line_batches_(line_batches)
+    {}
+
+    // Text must end at a line break unless it is the end of the file. Returns
+    // false once the pipeline has been closed
+    bool Add(std::string_view text, std::shared_ptr<const std::string> storage) {
+        if (batch_.storage != storage) {
+            if (!Flush()) {
+                return false;
+            }
+            batch_.storage = std::move(storage);
+        }
+        while (!text.empty()) {
+            const size_t line_end = std::min(text.find('\n'), text.size());
+            std::string_view line = text.substr(0, line_end);
+            text.remove_prefix(std::min(line_end + 1, text.size()));
+            ++line_number_;
+
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            if (line.empty()) {
+                continue;
+            }
+            batch_.lines.emplace_back(line_number_, line);
+            if (batch_.lines.size() == LINES_PER_BATCH && !Flush()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool Flush() {
+        if (batch_.lines.empty()) {
+            return true;
+        }
+        std::shared_ptr<const std::string> storage = batch_.storage;
+        const size_t next_index = batch_.index + 1;
+        const bool is_pushed = line_batches_.Push(std::move(batch_));
+        batch_ = { next_index, std::move(storage), {} };
+        return is_pushed;
+    }
+
+private:
+    BoundedQueue<LineBatch>& line_batches_;
+    LineBatch batch_;
+    size_t line_number_ = 0;
+};
+
+// Reads the file in chunks and passes on the complete lines of each chunk as
+// soon as it arrives, the unfinished last line is carried into the next chunk
+void ReadLines(CorpusFile& file, LineBatcher& batcher) {
+    std::string unfinished_line;
+    while (true) {
+        auto chunk = std::make_shared<std::string>(std::move(unfinished_line));
+        unfinished_line.clear();
+        const size_t old_size = chunk->size();
+        chunk->resize(old_size + READ_CHUNK_SIZE);
+        const size_t read_size = file.Read(chunk->data() + old_size, READ_CHUNK_SIZE);
+        chunk->resize(old_size + read_size);
+
+        if (read_size == 0) {
+            batcher.Add(*chunk, chunk);
+            return;
+        }
+        const size_t last_line_end = chunk->rfind('\n');
+        if (last_line_end == chunk->npos) {
+            unfinished_line = std::move(*chunk);
+            continue;
+        }
+        unfinished_line.assign(*chunk, last_line_end + 1);
+        chunk->resize(last_line_end + 1);
+        if (!batcher.Add(*chunk, chunk)) {
+            return;
+        }
+    }
+}
+
+std::string_view TakeField(std::string_view& line) {
+    const size_t tab_pos = line.find('\t');
+    if (tab_pos == line.npos) {
+        using namespace std::string_literals;
+        throw std::invalid_argument("Missing field separator"s);
+    }
+    const std::string_view field = line.substr(0, tab_pos);
+    line.remove_prefix(tab_pos + 1);
+    return field;
+}
+
+int ParseInt(std::string_view text) {
+    int value = 0;
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || end != text.data() + text.size()) {
+        using namespace std::string_literals;
+        throw std::invalid_argument("Invalid number "s + std::string(text));
+    }
+    return value;
+}
+
+DocumentStatus ParseStatus(std::string_view text) {
+    using namespace std::string_view_literals;
+    if (text == "ACTUAL"sv) {
+        return DocumentStatus::ACTUAL;
+    }
+    if (text == "IRRELEVANT"sv) {
+        return DocumentStatus::IRRELEVANT;
+    }
+    if (text == "BANNED"sv) {
+        return DocumentStatus::BANNED;
+    }
+    if (text == "REMOVED"sv) {
+        return DocumentStatus::REMOVED;
+    }
+    using namespace std::string_literals;
+    throw std::invalid_argument("Unknown status "s + std::string(text));
+}
+
+}  // namespace
+
+
+CorpusLine ParseCorpusLine(std::string_view line) {
+    CorpusLine result;
+    result.id = ParseInt(TakeField(line));
+    result.status = ParseStatus(TakeField(line));
+    for (const std::string_view rating : SplitIntoWords(TakeField(line))) {
+        result.ratings.push_back(ParseInt(rating));
+    }
+    result.text = line;
+    return result;
+}
+
+
+size_t LoadCorpus(SearchServer& search_server, const std::string& path, size_t tokenizer_count) {
+    if (tokenizer_count == 0) {
+        tokenizer_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    CorpusFile file(path);
+
+    BoundedQueue<LineBatch> line_batches(2 * tokenizer_count);
+    BoundedQueue<DocumentBatch> document_batches(2 * tokenizer_count);
+
+    std::mutex error_mutex;
+    std::exception_ptr first_error;
+    const auto fail = [&] (std::exception_ptr error) {
+        {
+            std::lock_guard guard(error_mutex);
+            if (!first_error) {
+                first_error = error;
+            }
+        }
+        line_batches.Close();
+        document_batches.Close();
+    };
+
+    // A tokenizer stops at the first bad line of its batch and hands the
+    // error to the indexer with the documents prepared before it
+    std::vector<std::thread> tokenizers;
+    for (size_t i = 0; i < tokenizer_count; ++i) {
+        tokenizers.emplace_back([&] {
+            while (auto batch = line_batches.Pop()) {
+                DocumentBatch documents;
+                documents.index = batch->index;
+                documents.documents.reserve(batch->lines.size());
+                for (const auto& [line_number, line] : batch->lines) {
+                    try {
+                        const CorpusLine corpus_line = ParseCorpusLine(line);
+                        documents.documents.emplace_back(line_number, search_server.PrepareDocument(
+                            corpus_line.id, corpus_line.text, corpus_line.status, corpus_line.ratings));
+                    }
+                    catch (...) {
+                        documents.error = AddLineNumber(line_number);
+                        break;
+                    }
+                }
+                const bool is_failed = static_cast<bool>(documents.error);
+                if (!document_batches.Push(std::move(documents)) || is_failed) {
+                    return;
+                }
+            }
+        });
+    }
+
+    // Batches arrive in any order, the indexer holds back those ahead of the
+    // next one in the file so documents are added and checked in file order
+    size_t added_count = 0;
+    std::thread indexer([&] {
+        std::map<size_t, DocumentBatch> early_batches;
+        size_t next_index = 0;
+        size_t line_number = 0;
+        try {
+            while (auto batch = document_batches.Pop()) {
+                early_batches.emplace(batch->index, std::move(*batch));
+                for (auto it = early_batches.begin();
+                     it != early_batches.end() && it->first == next_index;
+                     it = early_batches.erase(it), ++next_index) {
+                    for (auto& [number, document] : it->second.documents) {
+                        line_number = number;
+                        search_server.AddDocument(std::move(document));
+                        ++added_count;
+                    }
+                    if (it->second.error) {
+                        fail(it->second.error);
+                        return;
+                    }
+                }
+            }
+        }
+        catch (...) {
+            fail(AddLineNumber(line_number));
+        }
+    });
+
+    // The calling thread splits lines, a failure here still has to stop and join the other stages
+    try {
+        LineBatcher batcher(line_batches);
+        if (file.IsMapped()) {
+            batcher.Add(file.GetMapping(), nullptr);
+        }
+        else {
+            ReadLines(file, batcher);
+        }
+        batcher.Flush();
+    }
+    catch (...) {
+        fail(std::current_exception());
+    }
+
+    line_batches.Close();
+    for (std::thread& tokenizer : tokenizers) {
+        tokenizer.join();
+    }
+    document_batches.Close();
+    indexer.join();
+
+    if (first_error) {
+        std::rethrow_exception(first_error);
+    }
+    return added_count;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Corpus file format, one document per line:
+//   <id> TAB <status> TAB <ratings separated by spaces> TAB <text>
+// where status is ACTUAL, IRRELEVANT, BANNED or REMOVED. Empty lines are skipped
+
+struct CorpusLine {
+    int id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+    std::string_view text;  // points into the corpus buffer
+};
+
+// Throws std::invalid_argument on a malformed line
+CorpusLine ParseCorpusLine(std::string_view line);
+
+// Maps the file into memory (or, when it cannot be mapped, reads it in large
+// chunks passed on as they arrive) and indexes it through a pipeline: the
+// calling thread splits lines, tokenizer_count threads prepare documents, one
+// thread adds them to the server in file order. Stages are connected by bounded
+// queues, so reading, tokenizing and indexing overlap. Throws the error of the
+// first failing line, std::invalid_argument ones prefixed with its number, after
+// adding the documents before it. Returns the number of added documents
+size_t LoadCorpus(SearchServer& search_server, const std::string& path, size_t tokenizer_count = 0);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <iostream>
 
 struct Document {
@@ -19,4 +20,6 @@ enum class DocumentStatus {
     REMOVED,
 };
 
+const size_t DOCUMENT_STATUS_COUNT = 4;
+
 std::ostream& operator<< (std::ostream& os, const Document& document);
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "document_slot_map.h"
+
+#include <utility>
+
+void DocumentSlotMap::Insert(int document_id, uint32_t slot) {
+    if (2 * (size_ + 1) > cells_.size()) {
+        Rehash(cells_.empty() ? 16 : 2 * cells_.size());
+    }
+    size_t index = GetHomeIndex(document_id);
+    while (cells_[index].slot != EMPTY_SLOT) {
+        index = (index + 1) & (cells_.size() - 1);
+    }
+    cells_[index] = { document_id, slot };
+    ++size_;
+}
+
+void DocumentSlotMap::Erase(int document_id) {
+    if (cells_.empty()) {
+        return;
+    }
+    const size_t mask = cells_.size() - 1;
+    size_t hole = GetHomeIndex(document_id);
+    while (cells_[hole].slot != EMPTY_SLOT && cells_[hole].document_id != document_id) {
+        hole = (hole + 1) & mask;
+    }
+    if (cells_[hole].slot == EMPTY_SLOT) {
+        return;
+    }
+    --size_;
+
+    // Later cells of the run move back into the hole unless that would put
+    // them before their home index, so lookups never meet a gap
+    for (size_t index = (hole + 1) & mask; cells_[index].slot != EMPTY_SLOT; index = (index + 1) & mask) {
+        const size_t home = GetHomeIndex(cells_[index].document_id);
+        if (((index - home) & mask) >= ((index - hole) & mask)) {
+            cells_[hole] = cells_[index];
+            hole = index;
+        }
+    }
+    cells_[hole] = {};
+}
+
+size_t DocumentSlotMap::GetSize() const {
+    return size_;
+}
+
+size_t DocumentSlotMap::GetMemoryUsage() const {
+    return cells_.capacity() * sizeof(Cell);
+}
+
+void DocumentSlotMap::Rehash(size_t cell_count) {
+    std::vector<Cell> old_cells(cell_count);
+    old_cells.swap(cells_);
+    index_bits_ = 0;
+    while ((size_t(1) << index_bits_) < cell_count) {
+        ++index_bits_;
+    }
+    size_ = 0;
+    for (const Cell& cell : old_cells) {
+        if (cell.slot != EMPTY_SLOT) {
+            Insert(cell.document_id, cell.slot);
+        }
+    }
+}
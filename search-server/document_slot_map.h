@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Map from document ids to dense slots with open addressing and linear
+// probing. The search looks up a slot for every posting it visits, and a
+// probe here reads neighbouring cells of one array instead of following the
+// node pointers of std::unordered_map
+class DocumentSlotMap {
+public:
+    // Throws std::out_of_range for an unknown id
+    uint32_t At(int document_id) const {
+        if (!cells_.empty()) {
+            for (size_t index = GetHomeIndex(document_id); cells_[index].slot != EMPTY_SLOT;
+                 index = (index + 1) & (cells_.size() - 1)) {
+                if (cells_[index].document_id == document_id) {
+                    return cells_[index].slot;
+                }
+            }
+        }
+        using namespace std::string_literals;
+        throw std::out_of_range("Unknown document_id "s + std::to_string(document_id));
+    }
+
+    // The id must not be in the map yet
+    void Insert(int document_id, uint32_t slot);
+    void Erase(int document_id);
+
+    size_t GetSize() const;
+    // Heap bytes of the cell array
+    size_t GetMemoryUsage() const;
+
+private:
+    static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+    struct Cell {
+        int document_id = 0;
+        uint32_t slot = EMPTY_SLOT;
+    };
+    // Power of two sized and at most half full, so probe runs stay short
+    std::vector<Cell> cells_;
+    size_t size_ = 0;
+    uint32_t index_bits_ = 0;
+
+    // Low bits of the id with the higher bits folded in: postings are walked
+    // in id order, and close ids landing in close cells keeps those walks
+    // cache friendly, while ids differing only in high bits still spread out
+    size_t GetHomeIndex(int document_id) const {
+        const uint32_t id_bits = static_cast<uint32_t>(document_id);
+        uint32_t index = id_bits;
+        for (uint32_t shift = index_bits_; shift < 32; shift += index_bits_) {
+            index ^= id_bits >> shift;
+        }
+        return index & (cells_.size() - 1);
+    }
+
+    void Rehash(size_t cell_count);
+};
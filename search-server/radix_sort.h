@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <execution>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+
+// Stable LSD radix sort of values by ascending 64-bit keys, one byte per pass.
+// Passes where every key holds the same byte are skipped. With the parallel
+// policy each pass counts and scatters chunks of the input on separate threads,
+// chunk offsets are laid out digit by digit so equal keys keep their order.
+// Chunks depend on the size alone, so every machine takes the same path
+template <typename ExecutionPolicy, typename Value>
+void RadixSortByKeys(const ExecutionPolicy& execution_policy, std::vector<uint64_t>& keys, std::vector<Value>& values) {
+    const size_t DIGIT_BITS = 8;
+    const size_t DIGIT_COUNT = size_t(1) << DIGIT_BITS;
+    const size_t MIN_CHUNK_SIZE = 1 << 14;
+    const size_t MAX_CHUNK_COUNT = 64;
+
+    const size_t size = keys.size();
+    if (size < 2) {
+        return;
+    }
+    size_t chunk_count = 1;
+    if constexpr (std::is_same_v<ExecutionPolicy, std::execution::parallel_policy>) {
+        chunk_count = std::clamp<size_t>(size / MIN_CHUNK_SIZE, 1, MAX_CHUNK_COUNT);
+    }
+    const size_t chunk_size = (size + chunk_count - 1) / chunk_count;
+    std::vector<size_t> chunks(chunk_count);
+    std::iota(chunks.begin(), chunks.end(), 0);
+
+    std::vector<std::array<size_t, DIGIT_COUNT>> chunk_offsets(chunk_count);
+    std::vector<uint64_t> sorted_keys(size);
+    std::vector<Value> sorted_values(size);
+
+    for (size_t shift = 0; shift < 64; shift += DIGIT_BITS) {
+        const auto get_digit = [shift] (uint64_t key) {
+            return static_cast<size_t>(key >> shift) & (DIGIT_COUNT - 1);
+        };
+
+        std::for_each(execution_policy, chunks.begin(), chunks.end(), [&] (size_t chunk) {
+            auto& counts = chunk_offsets[chunk];
+            counts.fill(0);
+            const size_t chunk_end = std::min(size, (chunk + 1) * chunk_size);
+            for (size_t i = chunk * chunk_size; i < chunk_end; ++i) {
+                ++counts[get_digit(keys[i])];
+            }
+        });
+
+        const size_t first_digit = get_digit(keys.front());
+        size_t first_digit_count = 0;
+        for (const auto& counts : chunk_offsets) {
+            first_digit_count += counts[first_digit];
+        }
+        if (first_digit_count == size) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (size_t digit = 0; digit < DIGIT_COUNT; ++digit) {
+            for (auto& counts : chunk_offsets) {
+                const size_t count = counts[digit];
+                counts[digit] = offset;
+                offset += count;
+            }
+        }
+
+        std::for_each(execution_policy, chunks.begin(), chunks.end(), [&] (size_t chunk) {
+            auto& offsets = chunk_offsets[chunk];
+            const size_t chunk_end = std::min(size, (chunk + 1) * chunk_size);
+            for (size_t i = chunk * chunk_size; i < chunk_end; ++i) {
+                const size_t position = offsets[get_digit(keys[i])]++;
+                sorted_keys[position] = keys[i];
+                sorted_values[position] = std::move(values[i]);
+            }
+        });
+        keys.swap(sorted_keys);
+        values.swap(sorted_values);
+    }
+}
@@ -2,6 +2,7 @@
 #include "search_server.h"
 
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <set>
 #include <vector>
@@ -14,17 +15,14 @@ void RemoveDuplicates(SearchServer& search_server) {
         return;
     }
     
-    std::set<std::set<std::string>> list_of_line_sets;
+    std::set<std::set<std::string_view>> list_of_line_sets;
     std::vector<int> list_of_documents_for_deletion;
     for (const int document_id : search_server) {
-        std::set<std::string> string_sets;
-        for (const auto& [word, _] : search_server.GetWordFrequencies(document_id)) {
-            string_sets.insert(word);
-        }
+        std::set<std::string_view> string_sets = search_server.GetDocumentWords(document_id);
         if (list_of_line_sets.count(string_sets) > 0) {
             list_of_documents_for_deletion.push_back(document_id);
         }
-        list_of_line_sets.insert(string_sets);
+        list_of_line_sets.insert(std::move(string_sets));
     }
     
     for (const int id_duplicate : list_of_documents_for_deletion) {
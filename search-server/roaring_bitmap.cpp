@@ -0,0 +1,103 @@
+#include "roaring_bitmap.h"
+
+#include <algorithm>
+#include <numeric>
+
+void RoaringBitmap::Add(uint32_t value) {
+    const uint16_t key = static_cast<uint16_t>(value >> 16);
+    const uint16_t low = static_cast<uint16_t>(value);
+    auto it = std::lower_bound(containers_.begin(), containers_.end(), key,
+        [] (const Container& container, uint16_t key) { return container.key < key; });
+    if (it == containers_.end() || it->key != key) {
+        it = containers_.insert(it, Container{ key, 0, {}, {} });
+    }
+    Container& container = *it;
+
+    if (container.IsBitmap()) {
+        uint64_t& word = container.words[low >> 6];
+        const uint64_t bit = uint64_t(1) << (low & 63);
+        if ((word & bit) == 0) {
+            word |= bit;
+            ++container.cardinality;
+        }
+        return;
+    }
+
+    const auto value_it = std::lower_bound(container.values.begin(), container.values.end(), low);
+    if (value_it != container.values.end() && *value_it == low) {
+        return;
+    }
+    container.values.insert(value_it, low);
+    ++container.cardinality;
+
+    if (container.cardinality > ARRAY_CONTAINER_LIMIT) {
+        container.words.assign(BITMAP_WORD_COUNT, 0);
+        for (const uint16_t array_value : container.values) {
+            container.words[array_value >> 6] |= uint64_t(1) << (array_value & 63);
+        }
+        container.values.clear();
+        container.values.shrink_to_fit();
+    }
+}
+
+void RoaringBitmap::Remove(uint32_t value) {
+    const uint16_t key = static_cast<uint16_t>(value >> 16);
+    const uint16_t low = static_cast<uint16_t>(value);
+    const auto it = std::lower_bound(containers_.begin(), containers_.end(), key,
+        [] (const Container& container, uint16_t key) { return container.key < key; });
+    if (it == containers_.end() || it->key != key) {
+        return;
+    }
+    Container& container = *it;
+
+    if (container.IsBitmap()) {
+        uint64_t& word = container.words[low >> 6];
+        const uint64_t bit = uint64_t(1) << (low & 63);
+        if ((word & bit) == 0) {
+            return;
+        }
+        word &= ~bit;
+        --container.cardinality;
+        if (container.cardinality <= ARRAY_CONTAINER_LIMIT) {
+            // Back to the array form, one word at a time
+            for (size_t i = 0; i < BITMAP_WORD_COUNT; ++i) {
+                for (uint64_t bits = container.words[i]; bits != 0; bits &= bits - 1) {
+                    container.values.push_back(static_cast<uint16_t>(i * 64 + __builtin_ctzll(bits)));
+                }
+            }
+            container.words.clear();
+            container.words.shrink_to_fit();
+        }
+    }
+    else {
+        const auto value_it = std::lower_bound(container.values.begin(), container.values.end(), low);
+        if (value_it == container.values.end() || *value_it != low) {
+            return;
+        }
+        container.values.erase(value_it);
+        --container.cardinality;
+    }
+
+    if (container.cardinality == 0) {
+        containers_.erase(it);
+    }
+}
+
+uint64_t RoaringBitmap::GetCardinality() const {
+    return std::accumulate(containers_.begin(), containers_.end(), uint64_t(0),
+        [] (uint64_t cardinality, const Container& container) {
+            return cardinality + container.cardinality;
+        });
+}
+
+bool RoaringBitmap::IsEmpty() const {
+    return containers_.empty();
+}
+
+size_t RoaringBitmap::GetMemoryUsage() const {
+    size_t bytes = containers_.capacity() * sizeof(Container);
+    for (const Container& container : containers_) {
+        bytes += container.values.capacity() * sizeof(uint16_t) + container.words.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
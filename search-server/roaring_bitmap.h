@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Compressed set of 32-bit values in the Roaring layout: values are grouped
+// by their high 16 bits, a sparse group keeps a sorted array of low halves,
+// a dense one switches to a 65536-bit bitmap
+class RoaringBitmap {
+public:
+    void Add(uint32_t value);
+    void Remove(uint32_t value);
+
+    bool Contains(uint32_t value) const {
+        const Container* container = FindContainer(static_cast<uint16_t>(value >> 16));
+        if (container == nullptr) {
+            return false;
+        }
+        const uint16_t low = static_cast<uint16_t>(value);
+        if (container->IsBitmap()) {
+            return (container->words[low >> 6] >> (low & 63)) & 1;
+        }
+        return std::binary_search(container->values.begin(), container->values.end(), low);
+    }
+
+    // Calls callback(value) for every value of both sets in ascending order until it
+    // returns false. Two bitmap groups are intersected a 64-bit word at a time, an
+    // array group is probed against a bitmap or merged with another array
+    template <typename Callback>
+    bool ForEachCommonValue(const RoaringBitmap& other, Callback callback) const;
+
+    uint64_t GetCardinality() const;
+    bool IsEmpty() const;
+    // Estimated heap bytes of all containers
+    size_t GetMemoryUsage() const;
+
+private:
+    static constexpr uint32_t ARRAY_CONTAINER_LIMIT = 4096;
+    static constexpr size_t BITMAP_WORD_COUNT = 1024;
+
+    struct Container {
+        uint16_t key = 0;
+        uint32_t cardinality = 0;
+        std::vector<uint16_t> values;  // sorted, while cardinality <= ARRAY_CONTAINER_LIMIT
+        std::vector<uint64_t> words;   // BITMAP_WORD_COUNT words otherwise
+
+        bool IsBitmap() const {
+            return !words.empty();
+        }
+    };
+    std::vector<Container> containers_;  // sorted by key
+
+    const Container* FindContainer(uint16_t key) const {
+        const auto it = std::lower_bound(containers_.begin(), containers_.end(), key,
+            [] (const Container& container, uint16_t key) { return container.key < key; });
+        return it != containers_.end() && it->key == key ? &*it : nullptr;
+    }
+};
+
+template <typename Callback>
+bool RoaringBitmap::ForEachCommonValue(const RoaringBitmap& other, Callback callback) const {
+    auto lhs = containers_.begin();
+    auto rhs = other.containers_.begin();
+    while (lhs != containers_.end() && rhs != other.containers_.end()) {
+        if (lhs->key != rhs->key) {
+            lhs->key < rhs->key ? ++lhs : ++rhs;
+            continue;
+        }
+        const uint32_t high = uint32_t(lhs->key) << 16;
+        if (lhs->IsBitmap() && rhs->IsBitmap()) {
+            for (size_t i = 0; i < BITMAP_WORD_COUNT; ++i) {
+                for (uint64_t bits = lhs->words[i] & rhs->words[i]; bits != 0; bits &= bits - 1) {
+                    if (!callback(high | static_cast<uint32_t>(i * 64 + __builtin_ctzll(bits)))) {
+                        return false;
+                    }
+                }
+            }
+        }
+        else if (lhs->IsBitmap() || rhs->IsBitmap()) {
+            const Container& array = lhs->IsBitmap() ? *rhs : *lhs;
+            const Container& bitmap = lhs->IsBitmap() ? *lhs : *rhs;
+            for (const uint16_t low : array.values) {
+                if (((bitmap.words[low >> 6] >> (low & 63)) & 1) && !callback(high | low)) {
+                    return false;
+                }
+            }
+        }
+        else {
+            auto lhs_value = lhs->values.begin();
+            auto rhs_value = rhs->values.begin();
+            while (lhs_value != lhs->values.end() && rhs_value != rhs->values.end()) {
+                if (*lhs_value < *rhs_value) {
+                    ++lhs_value;
+                }
+                else if (*rhs_value < *lhs_value) {
+                    ++rhs_value;
+                }
+                else {
+                    if (!callback(high | *lhs_value)) {
+                        return false;
+                    }
+                    ++lhs_value;
+                    ++rhs_value;
+                }
+            }
+        }
+        ++lhs;
+        ++rhs;
+    }
+    return true;
+}
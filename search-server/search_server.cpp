@@ -12,45 +12,187 @@
 #include <execution>
 #include <utility>
 #include <string_view>
+#include <tuple>
 
 #include <iostream>
 
-SearchServer::SearchServer(const std::string& stop_words_text)
+void QueryStatistics::Merge(const QueryStatistics& other) {
+    document_count += other.document_count;
+    for (const auto& [word, document_freq] : other.document_freqs) {
+        document_freqs[word] += document_freq;
+    }
+}
+
+
+void CancellationToken::Cancel() const {
+    *is_cancelled_ = true;
+}
+
+
+bool CancellationToken::IsCancelled() const {
+    return *is_cancelled_;
+}
+
+
+uint64_t MakeDocumentOrderKey(const Document& document) {
+    const double relevance_steps = std::round(std::max(document.relevance, 0.0) / COMPARISON_LIMIT);
+    const uint32_t relevance_key = relevance_steps < UINT32_MAX ? static_cast<uint32_t>(relevance_steps) : UINT32_MAX;
+    // Flipping the sign bit maps signed ratings onto unsigned ones in the same order
+    const uint32_t rating_key = static_cast<uint32_t>(document.rating) ^ 0x80000000u;
+    return static_cast<uint64_t>(UINT32_MAX - relevance_key) << 32 | (UINT32_MAX - rating_key);
+}
+
+
+size_t IndexMemoryUsage::GetTotal() const {
+    return stop_words + term_dictionary + postings + forward_index + documents + attributes + filters;
+}
+
+
+SearchServer::SearchServer(const std::string& stop_words_text, const IndexOptions& options)
     : SearchServer(
-        SplitIntoWords(stop_words_text))  // Invoke delegating constructor from string container
+        SplitIntoWords(stop_words_text), options)  // Invoke delegating constructor from string container
 {}
-SearchServer::SearchServer(const std::string_view& stop_words_text)
+SearchServer::SearchServer(const std::string_view& stop_words_text, const IndexOptions& options)
     : SearchServer(
-        SplitIntoWords(stop_words_text))  // Invoke delegating constructor from string container
+        SplitIntoWords(stop_words_text), options)  // Invoke delegating constructor from string container
 {}
 
 
 void SearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status,
     const std::vector<int>& ratings) {
+    AddDocument(PrepareDocument(document_id, document, status, ratings));
+}
+
+
+PreparedDocument SearchServer::PrepareDocument(int document_id, const std::string_view document, DocumentStatus status,
+    const std::vector<int>& ratings) const {
+    return PrepareDocumentWith(stop_words_, document_id, document, status, ratings);
+}
+
+
+void SearchServer::AddDocument(PreparedDocument document) {
+    const int document_id = document.id;
     if ((document_id < 0) || (documents_.count(document_id) > 0)) {
         using namespace std::string_literals;
         throw std::invalid_argument("Invalid document_id"s);
     }
     
-    auto [doc_it, _] = documents_.emplace(document_id, DocumentData{std::string(document), ComputeAverageRating(ratings), status });
+    const std::map<int, double> term_freqs = ComputeTermFreqs(document);
+    auto [doc_it, _] = documents_.emplace(document_id, DocumentData{ std::move(document.content), {} });
     document_ids_.insert(document_id);
     
-    const auto words = SplitIntoWordsNoStop(doc_it->second.content);
+    const uint32_t slot = AcquireDocumentSlot(document_id);
+    document_statuses_[slot] = document.status;
+    document_ratings_[slot] = document.rating;
     
-    const double inv_word_count = 1.0 / words.size();
-    for (const auto& word : words) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][word] += inv_word_count;
+    const size_t status = static_cast<size_t>(document.status);
+    std::vector<int>& term_ids = doc_it->second.term_ids;
+    term_ids.reserve(term_freqs.size());
+    for (const auto [term_id, term_freq] : term_freqs) {
+        InsertPosting(term_id, status, document_id, term_freq);
+        if (!options_.compact_forward_index) {
+            document_to_word_freqs_[document_id][term_id_to_word_[term_id]] = term_freq;
+        }
+        term_ids.push_back(term_id);
     }
+    
+    RefreshFilters(document_id);
+}
+
+
+void SearchServer::UpdateDocument(int document_id, const std::string_view document, DocumentStatus status,
+    const std::vector<int>& ratings) {
+    const auto document_it = documents_.find(document_id);
+    if (document_it == documents_.end()) {
+        using namespace std::string_literals;
+        throw std::invalid_argument("Invalid document_id"s);
+    }
+    
+    PreparedDocument prepared = PrepareDocument(document_id, document, status, ratings);
+    const std::map<int, double> new_term_freqs = ComputeTermFreqs(prepared);
+    const size_t old_status = static_cast<size_t>(GetDocumentStatus(document_id));
+    const size_t new_status = static_cast<size_t>(status);
+    
+    // Both term lists are sorted, one merge pass finds dropped, added and kept words
+    std::vector<int>& term_ids = document_it->second.term_ids;
+    auto old_it = term_ids.begin();
+    auto new_it = new_term_freqs.begin();
+    while (old_it != term_ids.end() || new_it != new_term_freqs.end()) {
+        if (new_it == new_term_freqs.end() || (old_it != term_ids.end() && *old_it < new_it->first)) {
+            ErasePosting(*old_it++, old_status, document_id);
+            continue;
+        }
+        const auto [term_id, term_freq] = *new_it++;
+        if (old_it == term_ids.end() || term_id < *old_it) {
+            InsertPosting(term_id, new_status, document_id, term_freq);
+            continue;
+        }
+        ++old_it;
+        const double old_term_freq = word_to_document_freqs_.at(term_id_to_word_[term_id])[old_status].at(document_id);
+        if (old_term_freq != term_freq) {
+            ErasePosting(term_id, old_status, document_id);
+            InsertPosting(term_id, new_status, document_id, term_freq);
+        }
+        else if (old_status != new_status) {
+            MovePosting(term_id, old_status, new_status, document_id);
+        }
+    }
+    
+    term_ids.clear();
+    for (const auto& [term_id, _] : new_term_freqs) {
+        term_ids.push_back(term_id);
+    }
+    word_freqs_cache_.erase(document_id);
+    if (!options_.compact_forward_index) {
+        auto& word_freqs = document_to_word_freqs_[document_id];
+        word_freqs.clear();
+        for (const auto [term_id, term_freq] : new_term_freqs) {
+            word_freqs.emplace(term_id_to_word_[term_id], term_freq);
+        }
+    }
+    document_it->second.content = std::move(prepared.content);
+    const uint32_t slot = document_slots_.At(document_id);
+    document_statuses_[slot] = status;
+    document_ratings_[slot] = prepared.rating;
+    
+    RefreshFilters(document_id);
+}
+
+
+void SearchServer::SetDocumentStatus(int document_id, DocumentStatus status) {
+    const auto document_it = documents_.find(document_id);
+    if (document_it == documents_.end()) {
+        using namespace std::string_literals;
+        throw std::invalid_argument("Invalid document_id"s);
+    }
+    const size_t old_status = static_cast<size_t>(GetDocumentStatus(document_id));
+    const size_t new_status = static_cast<size_t>(status);
+    if (old_status == new_status) {
+        return;
+    }
+    for (const int term_id : document_it->second.term_ids) {
+        MovePosting(term_id, old_status, new_status, document_id);
+    }
+    document_statuses_[document_slots_.At(document_id)] = status;
+    
+    RefreshFilters(document_id);
+}
+
+
+void SearchServer::SetDocumentRating(int document_id, int rating) {
+    if (documents_.count(document_id) == 0) {
+        using namespace std::string_literals;
+        throw std::invalid_argument("Invalid document_id"s);
+    }
+    document_ratings_[document_slots_.At(document_id)] = rating;
+    
+    RefreshFilters(document_id);
 }
 
 
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query, 
                                                      DocumentStatus status) const {
-    return FindTopDocuments(std::execution::seq, 
-        raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-            return document_status == status;
-        });
+    return FindTopDocuments(std::execution::seq, raw_query, status);
 }
 
 
@@ -59,71 +201,307 @@ std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw
 }
 
 
-int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+std::vector<Document> SearchServer::FindAllDocuments(const std::string_view& raw_query, 
+                                                     DocumentStatus status) const {
+    return FindAllDocuments(std::execution::seq, raw_query, status);
 }
 
 
-Match_Document SearchServer::MatchDocument(const std::string_view& raw_query,
-                                           int document_id) const {
-    return MatchDocument(std::execution::seq, raw_query, document_id);
+std::vector<Document> SearchServer::FindAllDocuments(const std::string_view& raw_query) const {
+    return FindAllDocuments(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
 }
 
 
-Match_Document SearchServer::MatchDocument(const std::execution::sequenced_policy&, 
-                            const std::string_view& raw_query, int document_id) const {
-    const auto query = ParseQuery(raw_query);
+std::vector<std::vector<Document>> SearchServer::FindTopDocumentsBatch(
+    const std::vector<std::string>& raw_queries) const {
+    std::vector<Query> unique_queries;
+    std::vector<size_t> first_raw_indexes;  // by unique query
+    std::vector<size_t> unique_indexes;     // by raw query
+    unique_indexes.reserve(raw_queries.size());
+    using QueryKey = std::tuple<std::vector<std::string_view>, std::vector<std::string_view>,
+                                std::vector<std::string_view>>;
+    std::map<QueryKey, size_t> query_to_unique_index;
+    for (size_t i = 0; i < raw_queries.size(); ++i) {
+        Query query = ParseQuery(raw_queries[i]);
+        QueryKey key{ query.plus_words, query.minus_words, query.required_words };
+        const auto [it, is_new] = query_to_unique_index.emplace(std::move(key), unique_queries.size());
+        if (is_new) {
+            unique_queries.push_back(std::move(query));
+            first_raw_indexes.push_back(i);
+        }
+        unique_indexes.push_back(it->second);
+    }
     
-    for (const std::string_view& word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+    // Queries taking another path of FindTopDocuments are answered by it
+    const auto is_shared = [this] (const Query& query) {
+        return query.required_words.empty() && !options_.impact_ordered_postings;
+    };
+    struct WordQueries {
+        std::vector<size_t> query_indexes;
+        size_t first_unvisited = 0;
+    };
+    std::map<std::string_view, WordQueries> word_to_queries;
+    for (size_t i = 0; i < unique_queries.size(); ++i) {
+        if (is_shared(unique_queries[i])) {
+            for (const std::string_view word : unique_queries[i].plus_words) {
+                if (word_to_document_freqs_.count(word) > 0) {
+                    word_to_queries[word].query_indexes.push_back(i);
+                }
+            }
+        }
+    }
+    
+    // A group grows by the queries sharing a word with one of its members, a query
+    // sharing no word with others is a group of its own. Every query list is
+    // visited once across all groups, since grouped queries never come back
+    std::vector<std::vector<size_t>> groups;
+    std::vector<bool> is_grouped(unique_queries.size());
+    for (size_t first = 0; first < unique_queries.size(); ++first) {
+        if (is_grouped[first]) {
             continue;
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            return { {}, documents_.at(document_id).status };
+        is_grouped[first] = true;
+        std::vector<size_t> group = { first };
+        for (size_t member = 0; member < group.size() && is_shared(unique_queries[first]); ++member) {
+            for (const std::string_view word : unique_queries[group[member]].plus_words) {
+                const auto word_it = word_to_queries.find(word);
+                if (word_it == word_to_queries.end()) {
+                    continue;
+                }
+                WordQueries& word_queries = word_it->second;
+                while (word_queries.first_unvisited < word_queries.query_indexes.size()
+                       && group.size() < BATCH_GROUP_SIZE) {
+                    const size_t query_index = word_queries.query_indexes[word_queries.first_unvisited++];
+                    if (!is_grouped[query_index]) {
+                        is_grouped[query_index] = true;
+                        group.push_back(query_index);
+                    }
+                }
+            }
         }
+        groups.push_back(std::move(group));
     }
     
-    std::vector<std::string_view> matched_words;
-    for (const std::string_view& word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+    const size_t status = static_cast<size_t>(DocumentStatus::ACTUAL);
+    std::vector<std::vector<Document>> unique_results(unique_queries.size());
+    std::for_each(std::execution::par, groups.begin(), groups.end(), [&] (const std::vector<size_t>& group) {
+        if (group.size() == 1) {
+            unique_results[group[0]] = FindTopDocuments(std::execution::seq, raw_queries[first_raw_indexes[group[0]]],
+                                                        DocumentStatus::ACTUAL);
+            // Results live until the whole batch is done, the room of all matches is not kept
+            unique_results[group[0]].shrink_to_fit();
+            return;
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.push_back(word);
+        
+        // Words go in lexicographic order, the order of plus words within each
+        // query, so every relevance is summed exactly as FindTopDocuments sums it
+        std::map<std::string_view, std::vector<size_t>> word_to_members;
+        for (size_t member = 0; member < group.size(); ++member) {
+            for (const std::string_view word : unique_queries[group[member]].plus_words) {
+                word_to_members[word].push_back(member);
+            }
+        }
+        std::vector<BatchWord> words;
+        size_t longest_word = 0;
+        for (auto& [word, members] : word_to_members) {
+            const auto word_it = word_to_document_freqs_.find(word);
+            if (word_it == word_to_document_freqs_.end() || word_it->second[status].empty()) {
+                continue;
+            }
+            words.push_back({ &word_it->second[status], ComputeWordInverseDocumentFreq(word), std::move(members) });
+            if (words.back().postings->size() > words[longest_word].postings->size()) {
+                longest_word = words.size() - 1;
+            }
         }
+        
+        // Ranges of ids cut at quantiles of the longest posting list hold similar
+        // work however the ids are spread, and let threads share a large group
+        std::vector<int> range_begins = { 0 };
+        if (!words.empty()) {
+            const std::map<int, double>& longest_postings = *words[longest_word].postings;
+            const size_t range_count = longest_postings.size() / BATCH_RANGE_POSTINGS + 1;
+            size_t position = 0;
+            for (const auto& [document_id, _] : longest_postings) {
+                if (range_begins.size() == range_count) {
+                    break;
+                }
+                if (position++ == longest_postings.size() * range_begins.size() / range_count) {
+                    range_begins.push_back(document_id);
+                }
+            }
+        }
+        std::vector<std::vector<std::vector<Document>>> range_matches(
+            range_begins.size(), std::vector<std::vector<Document>>(group.size()));
+        std::vector<size_t> ranges(range_begins.size());
+        std::iota(ranges.begin(), ranges.end(), 0);
+        std::for_each(std::execution::par, ranges.begin(), ranges.end(), [&] (size_t range) {
+            const std::optional<int> range_end = range + 1 < range_begins.size()
+                ? std::optional<int>(range_begins[range + 1]) : std::nullopt;
+            ScoreBatchGroup(words, range_begins[range], range_end, range_matches[range]);
+        });
+        
+        for (size_t member = 0; member < group.size(); ++member) {
+            const std::vector<int> minus_term_ids = ResolveQuery(unique_queries[group[member]]).minus_term_ids;
+            std::vector<Document>& matched_documents = unique_results[group[member]];
+            for (auto& matches : range_matches) {
+                for (const Document& document : matches[member]) {
+                    if (minus_term_ids.empty() || !HasAnyTerm(document.id, minus_term_ids)) {
+                        matched_documents.push_back(document);
+                    }
+                }
+                std::vector<Document>().swap(matches[member]);
+            }
+            KeepTopDocuments(std::execution::seq, matched_documents);
+            matched_documents.shrink_to_fit();
+        }
+    });
+    
+    std::vector<std::vector<Document>> result(raw_queries.size());
+    for (size_t i = 0; i < raw_queries.size(); ++i) {
+        result[i] = unique_results[unique_indexes[i]];
     }
-
-    return { matched_words, documents_.at(document_id).status };
+    return result;
 }
 
 
-Match_Document SearchServer::MatchDocument(const std::execution::parallel_policy&, 
-                            const std::string_view& raw_query, int document_id) const {
-    // PARALELKA
-    const auto query = ParseQuery(raw_query, true);
-    
-    if (std::any_of(std::execution::par, query.minus_words.begin(), query.minus_words.end(),
-                    [&] (const auto& minus_word) {
-                        const auto it = word_to_document_freqs_.find(minus_word);
-                        return it != word_to_document_freqs_.end() && it->second.count(document_id);
-                    })) {
-        return {{},documents_.at(document_id).status};
-    }
-    
-    std::vector<std::string_view> matched_words(query.plus_words.size());
-    auto it_matched_words_end =  std::copy_if(std::execution::par,
-        query.plus_words.begin(), query.plus_words.end(),
-        matched_words.begin(),
-        [&](const auto& plus_word) {
-            const auto it = word_to_document_freqs_.find(plus_word);
-            return it != word_to_document_freqs_.end() && it->second.count(document_id);
+void SearchServer::ScoreBatchGroup(const std::vector<BatchWord>& words, int range_begin,
+                                   std::optional<int> range_end,
+                                   std::vector<std::vector<Document>>& member_matches) const {
+    using PostingIterator = std::map<int, double>::const_iterator;
+    std::vector<std::pair<PostingIterator, PostingIterator>> cursors;
+    // Next document of every word, smallest id first and words of one document in
+    // their order, a document is complete once the top moves past its id
+    std::vector<std::pair<int, size_t>> next_postings;
+    for (size_t word_index = 0; word_index < words.size(); ++word_index) {
+        const std::map<int, double>& postings = *words[word_index].postings;
+        cursors.emplace_back(postings.lower_bound(range_begin),
+                             range_end ? postings.lower_bound(*range_end) : postings.end());
+        if (cursors.back().first != cursors.back().second) {
+            next_postings.emplace_back(cursors.back().first->first, word_index);
         }
-    );
-    
-    std::sort(std::execution::par, matched_words.begin(), it_matched_words_end);
-    matched_words.erase(std::unique(std::execution::par,matched_words.begin(), it_matched_words_end), matched_words.end());
+    }
+    const auto is_later = [] (const std::pair<int, size_t>& lhs, const std::pair<int, size_t>& rhs) {
+        return lhs > rhs;
+    };
+    std::make_heap(next_postings.begin(), next_postings.end(), is_later);
     
-    return { matched_words, documents_.at(document_id).status };
+    std::vector<double> relevances(member_matches.size());
+    std::vector<bool> is_scored(member_matches.size());
+    std::vector<size_t> scored_members;
+    while (!next_postings.empty()) {
+        const int document_id = next_postings.front().first;
+        while (!next_postings.empty() && next_postings.front().first == document_id) {
+            std::pop_heap(next_postings.begin(), next_postings.end(), is_later);
+            const BatchWord& word = words[next_postings.back().second];
+            auto& [posting_it, postings_end] = cursors[next_postings.back().second];
+            const double word_relevance = posting_it->second * word.inverse_document_freq;
+            for (const size_t member : word.members) {
+                if (!is_scored[member]) {
+                    is_scored[member] = true;
+                    scored_members.push_back(member);
+                }
+                relevances[member] += word_relevance;
+            }
+            if (++posting_it != postings_end) {
+                next_postings.back().first = posting_it->first;
+                std::push_heap(next_postings.begin(), next_postings.end(), is_later);
+            }
+            else {
+                next_postings.pop_back();
+            }
+        }
+        
+        const int rating = GetDocumentRating(document_id);
+        for (const size_t member : scored_members) {
+            member_matches[member].push_back({ document_id, relevances[member], rating });
+            relevances[member] = 0.0;
+            is_scored[member] = false;
+        }
+        scored_members.clear();
+    }
+}
+
+
+std::future<PartialSearchResult> SearchServer::FindTopDocumentsAsync(const std::string_view& raw_query, 
+                                                                     DocumentStatus status,
+                                                                     const SearchLimits& limits) const {
+    return FindTopDocumentsAsync(
+        raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+            return document_status == status;
+        }, limits);
+}
+
+
+std::future<PartialSearchResult> SearchServer::FindTopDocumentsAsync(const std::string_view& raw_query, 
+                                                                     const SearchLimits& limits) const {
+    return FindTopDocumentsAsync(raw_query, DocumentStatus::ACTUAL, limits);
+}
+
+
+void SearchServer::RegisterFilter(const std::string& name, DocumentFilter predicate) {
+    NamedFilter filter{ std::move(predicate), {} };
+    for (const int document_id : document_ids_) {
+        if (filter.predicate(document_id, GetDocumentStatus(document_id), GetDocumentRating(document_id))) {
+            filter.document_ids.Add(document_id);
+        }
+    }
+    filters_.insert_or_assign(name, std::move(filter));
+}
+
+
+void SearchServer::UnregisterFilter(const std::string_view& name) {
+    const auto it = filters_.find(name);
+    if (it != filters_.end()) {
+        filters_.erase(it);
+    }
+}
+
+
+std::vector<Document> SearchServer::FindTopDocumentsWithFilter(const std::string_view& raw_query, 
+                                                               const std::string_view& filter_name) const {
+    return FindTopDocumentsWithFilter(std::execution::seq, raw_query, filter_name);
+}
+
+
+int SearchServer::GetDocumentCount() const {
+    return documents_.size();
+}
+
+
+QueryStatistics SearchServer::GetQueryStatistics(const std::string_view& raw_query) const {
+    QueryStatistics statistics;
+    statistics.document_count = GetDocumentCount();
+    for (const std::string_view word : ParseQuery(raw_query).plus_words) {
+        const auto it = word_to_document_freqs_.find(word);
+        if (it != word_to_document_freqs_.end()) {
+            statistics.document_freqs.emplace(word, static_cast<int>(CountDocuments(it->second)));
+        }
+    }
+    return statistics;
+}
+
+
+Match_Document SearchServer::MatchDocument(const std::string_view& raw_query,
+                                           int document_id) const {
+    return MatchDocument(std::execution::seq, raw_query, document_id);
+}
+
+
+Match_Document SearchServer::MatchDocument(const std::execution::sequenced_policy& execution_policy, 
+                            const std::string_view& raw_query, int document_id) const {
+    return MatchResolvedQuery(execution_policy, ResolveQuery(ParseQuery(raw_query)), document_id);
+}
+
+
+Match_Document SearchServer::MatchDocument(const std::execution::parallel_policy& execution_policy, 
+                            const std::string_view& raw_query, int document_id) const {
+    return MatchResolvedQuery(execution_policy, ResolveQuery(ParseQuery(raw_query)), document_id);
+}
+
+
+std::vector<Match_Document> SearchServer::MatchDocuments(const std::string_view& raw_query,
+                                                         const std::vector<int>& document_ids) const {
+    return MatchDocuments(std::execution::seq, raw_query, document_ids);
 }
 
 
@@ -138,13 +516,125 @@ std::set<int>::const_iterator SearchServer::end() const {
 
 
 const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    const auto it = document_to_word_freqs_.find(document_id);
-    if (it != document_to_word_freqs_.end()) {
-        return it -> second;
+    static const std::map<std::string_view, double> void_map;
+    
+    if (!options_.compact_forward_index) {
+        const auto it = document_to_word_freqs_.find(document_id);
+        if (it != document_to_word_freqs_.end()) {
+            return it -> second;
+        }
+        return void_map;
     }
     
-    static const std::map<std::string_view, double> void_map;
-    return void_map;
+    const auto document_it = documents_.find(document_id);
+    if (document_it == documents_.end()) {
+        return void_map;
+    }
+    std::lock_guard<std::mutex> lock_guard_mutex(word_freqs_cache_mutex_);
+    auto [cache_it, is_missing] = word_freqs_cache_.try_emplace(document_id);
+    if (is_missing) {
+        const size_t status = static_cast<size_t>(GetDocumentStatus(document_id));
+        for (const int term_id : document_it->second.term_ids) {
+            const std::string_view word = term_id_to_word_[term_id];
+            cache_it->second.emplace(word, word_to_document_freqs_.at(word)[status].at(document_id));
+        }
+    }
+    return cache_it->second;
+}
+
+
+std::set<std::string_view> SearchServer::GetDocumentWords(int document_id) const {
+    std::set<std::string_view> words;
+    const auto document_it = documents_.find(document_id);
+    if (document_it == documents_.end()) {
+        return words;
+    }
+    for (const int term_id : document_it->second.term_ids) {
+        words.insert(words.end(), term_id_to_word_[term_id]);
+    }
+    return words;
+}
+
+
+namespace {
+
+// Colour and three links of a red-black tree node
+const size_t TREE_NODE_OVERHEAD = 4 * sizeof(void*);
+
+template <typename Tree>
+size_t ComputeTreeBytes(const Tree& tree) {
+    return tree.size() * (TREE_NODE_OVERHEAD + sizeof(typename Tree::value_type));
+}
+
+template <typename Value>
+size_t ComputeVectorBytes(const std::vector<Value>& values) {
+    return values.capacity() * sizeof(Value);
+}
+
+size_t ComputeStringBytes(const std::string& text) {
+    static const size_t INLINE_CAPACITY = std::string().capacity();
+    return text.capacity() > INLINE_CAPACITY ? text.capacity() + 1 : 0;
+}
+
+}  // namespace
+
+
+IndexMemoryUsage SearchServer::GetMemoryUsage() const {
+    IndexMemoryUsage usage;
+    
+    usage.stop_words = stop_words_.GetMemoryUsage();
+    
+    usage.term_dictionary = ComputeTreeBytes(word_to_term_id_) + ComputeVectorBytes(term_id_to_word_);
+    for (const auto& [word, _] : word_to_term_id_) {
+        usage.term_dictionary += ComputeStringBytes(word);
+    }
+    
+    usage.postings = ComputeTreeBytes(word_to_document_freqs_);
+    for (const auto& [_, status_postings] : word_to_document_freqs_) {
+        for (const auto& postings : status_postings) {
+            usage.postings += ComputeTreeBytes(postings);
+        }
+    }
+    
+    usage.postings += ComputeVectorBytes(term_id_to_document_ids_);
+    for (const RoaringBitmap& document_ids : term_id_to_document_ids_) {
+        usage.postings += document_ids.GetMemoryUsage();
+    }
+    
+    usage.postings += ComputeTreeBytes(word_to_impact_postings_);
+    for (const auto& [_, impact_postings] : word_to_impact_postings_) {
+        for (const auto& postings : impact_postings) {
+            usage.postings += ComputeTreeBytes(postings);
+        }
+    }
+    
+    usage.forward_index = ComputeTreeBytes(document_to_word_freqs_);
+    for (const auto& [_, word_freqs] : document_to_word_freqs_) {
+        usage.forward_index += ComputeTreeBytes(word_freqs);
+    }
+    {
+        std::lock_guard<std::mutex> lock_guard_mutex(word_freqs_cache_mutex_);
+        usage.forward_index += ComputeTreeBytes(word_freqs_cache_);
+        for (const auto& [_, word_freqs] : word_freqs_cache_) {
+            usage.forward_index += ComputeTreeBytes(word_freqs);
+        }
+    }
+    
+    usage.documents = ComputeTreeBytes(documents_) + ComputeTreeBytes(document_ids_);
+    for (const auto& [_, document_data] : documents_) {
+        usage.documents += ComputeStringBytes(document_data.content);
+        usage.forward_index += ComputeVectorBytes(document_data.term_ids);
+    }
+    
+    usage.attributes = ComputeVectorBytes(document_statuses_) + ComputeVectorBytes(document_ratings_)
+        + ComputeVectorBytes(free_slots_) + document_slots_.GetMemoryUsage();
+    
+    usage.filters = ComputeTreeBytes(filters_);
+    for (const auto& [name, filter] : filters_) {
+        usage.filters += ComputeStringBytes(name) + filter.document_ids.GetMemoryUsage();
+    }
+    
+    return usage;
 }
 
 
@@ -154,71 +644,90 @@ void SearchServer::RemoveDocument(int document_id) {
 
 
 void SearchServer::RemoveDocument(const std::execution::sequenced_policy&, int document_id) {
-    auto word_list_document = GetWordFrequencies(document_id);
-    if (word_list_document.empty()) {
+    const auto document_it = documents_.find(document_id);
+    if (document_it == documents_.end()) {
         return;
     }
-    documents_.erase(document_id);
-    for (auto& [word, _] : word_list_document) {
-        word_to_document_freqs_.at(word).erase(document_id);
+    const size_t status = static_cast<size_t>(GetDocumentStatus(document_id));
+    for (const int term_id : document_it->second.term_ids) {
+        ErasePosting(term_id, status, document_id);
     }
+    documents_.erase(document_it);
     document_to_word_freqs_.erase(document_id);
+    word_freqs_cache_.erase(document_id);
     document_ids_.erase(document_id);
+    ReleaseDocumentSlot(document_id);
+    RefreshFilters(document_id);
 }
 
 
 void SearchServer::RemoveDocument(const std::execution::parallel_policy&, int document_id) {
-    
-    const auto& it = document_to_word_freqs_.find(document_id);
-    if (it == document_to_word_freqs_.end()) {
+    const auto document_it = documents_.find(document_id);
+    if (document_it == documents_.end()) {
         return;
     }
     
-    std::vector<const std::string_view*> deleted_word_of_document(it->second.size());
-    
-    std::transform(std::execution::par,
-                  it->second.begin(), it->second.end(),
-                  deleted_word_of_document.begin(),
-                  [] (const auto& pair_word_freq_in_doc) {
-                      return &pair_word_freq_in_doc.first;
-                  });
-    
+    const size_t status = static_cast<size_t>(GetDocumentStatus(document_id));
+    const std::vector<int>& term_ids = document_it->second.term_ids;
     std::for_each(std::execution::par,
-                  deleted_word_of_document.begin(), deleted_word_of_document.end(), 
-                  [&] (const std::string_view* word) {
-                      word_to_document_freqs_[*word].erase(document_id);
+                  term_ids.begin(), term_ids.end(), 
+                  [&] (int term_id) {
+                      ErasePosting(term_id, status, document_id);
                   });
     
-    documents_.erase(document_id);
+    documents_.erase(document_it);
     
     document_to_word_freqs_.erase(document_id);
+    word_freqs_cache_.erase(document_id);
     document_ids_.erase(document_id);
+    ReleaseDocumentSlot(document_id);
+    RefreshFilters(document_id);
 }
 
 
-bool SearchServer::IsStopWord(const std::string_view word) const {
-    return stop_words_.count(word) > 0;
+uint32_t SearchServer::AcquireDocumentSlot(int document_id) {
+    uint32_t slot = static_cast<uint32_t>(document_statuses_.size());
+    if (!free_slots_.empty()) {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+    }
+    else {
+        document_statuses_.emplace_back();
+        document_ratings_.emplace_back();
+    }
+    document_slots_.Insert(document_id, slot);
+    return slot;
 }
-bool SearchServer::IsValidWord(const std::string_view word) {
-    // A valid word must not contain special characters
-    return std::none_of(word.begin(), word.end(), [](char c) {
-        return c >= '\0' && c < ' ';
-    });
+
+
+void SearchServer::ReleaseDocumentSlot(int document_id) {
+    free_slots_.push_back(document_slots_.At(document_id));
+    document_slots_.Erase(document_id);
 }
 
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view& text) const {
-    std::vector<std::string_view> words;
-    for (const std::string_view& word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            using namespace std::string_literals;
-            throw std::invalid_argument("Word "s + std::string(word) + " is invalid"s);
+void SearchServer::RefreshFilters(int document_id) {
+    const bool is_present = documents_.count(document_id) > 0;
+    for (auto& [_, filter] : filters_) {
+        if (is_present
+            && filter.predicate(document_id, GetDocumentStatus(document_id), GetDocumentRating(document_id))) {
+            filter.document_ids.Add(document_id);
         }
-        if (!IsStopWord(word)) {
-            words.push_back(word);
+        else {
+            filter.document_ids.Remove(document_id);
         }
     }
-    return words;
+}
+
+
+bool SearchServer::IsStopWord(const std::string_view word) const {
+    return stop_words_.count(word);
+}
+bool SearchServer::IsValidWord(const std::string_view word) {
+    // A valid word must not contain special characters
+    return std::none_of(word.begin(), word.end(), [](char c) {
+        return c >= '\0' && c < ' ';
+    });
 }
 
 
@@ -231,6 +740,70 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
 }
 
 
+int SearchServer::GetOrCreateTermId(const std::string_view word) {
+    const auto it = word_to_term_id_.find(word);
+    if (it != word_to_term_id_.end()) {
+        return it->second;
+    }
+    const int term_id = static_cast<int>(term_id_to_word_.size());
+    const auto [inserted_it, _] = word_to_term_id_.emplace(std::string(word), term_id);
+    term_id_to_word_.push_back(inserted_it->first);
+    term_id_to_document_ids_.emplace_back();
+    return term_id;
+}
+
+
+int SearchServer::QuantizeImpact(double term_freq) {
+    return std::clamp(static_cast<int>(std::ceil(term_freq * IMPACT_LEVELS)), 1, IMPACT_LEVELS);
+}
+
+
+std::map<int, double> SearchServer::ComputeTermFreqs(const PreparedDocument& document) {
+    std::map<int, double> term_freqs;
+    const std::string_view content = document.content;
+    const double inv_word_count = 1.0 / document.words.size();
+    for (const auto& [offset, size] : document.words) {
+        term_freqs[GetOrCreateTermId(content.substr(offset, size))] += inv_word_count;
+    }
+    return term_freqs;
+}
+
+
+void SearchServer::InsertPosting(int term_id, size_t status, int document_id, double term_freq) {
+    const std::string_view word = term_id_to_word_[term_id];
+    word_to_document_freqs_[word][status][document_id] = term_freq;
+    term_id_to_document_ids_[term_id].Add(static_cast<uint32_t>(document_id));
+    if (options_.impact_ordered_postings) {
+        word_to_impact_postings_[word][status].insert({ QuantizeImpact(term_freq), document_id, term_freq });
+    }
+}
+
+
+void SearchServer::ErasePosting(int term_id, size_t status, int document_id) {
+    const std::string_view word = term_id_to_word_[term_id];
+    auto& postings = word_to_document_freqs_.at(word)[status];
+    if (options_.impact_ordered_postings) {
+        const double term_freq = postings.at(document_id);
+        word_to_impact_postings_.at(word)[status].erase({ QuantizeImpact(term_freq), document_id, term_freq });
+    }
+    postings.erase(document_id);
+    term_id_to_document_ids_[term_id].Remove(static_cast<uint32_t>(document_id));
+}
+
+
+void SearchServer::MovePosting(int term_id, size_t old_status, size_t new_status, int document_id) {
+    const std::string_view word = term_id_to_word_[term_id];
+    auto& postings = word_to_document_freqs_.at(word);
+    const double term_freq = postings[old_status].at(document_id);
+    postings[new_status].insert(postings[old_status].extract(document_id));
+    if (options_.impact_ordered_postings) {
+        auto& impact_postings = word_to_impact_postings_.at(word);
+        impact_postings[new_status].insert(
+            impact_postings[old_status].extract({ QuantizeImpact(term_freq), document_id, term_freq }));
+    }
+}
+
+
 SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view& text) const {
     using namespace std::string_literals;
     if (text.empty()) {
@@ -238,19 +811,24 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view& tex
     }
     std::string_view word = text;
     bool is_minus = false;
+    bool is_required = false;
     if (text[0] == '-') {
         is_minus = true;
         word = text.substr(1);
     }
-    if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
+    else if (text[0] == '+') {
+        is_required = true;
+        word = text.substr(1);
+    }
+    if (word.empty() || word[0] == '-' || word[0] == '+' || !IsValidWord(word)) {
         throw std::invalid_argument("Query word "s + std::string(word) + " is invalid"s);
     }
 
-    return { word, is_minus, IsStopWord(word) };
+    return { word, is_minus, is_required, IsStopWord(word) };
 }
 
 
-SearchServer::Query SearchServer::ParseQuery(const std::string_view& text, bool is_not_sort) const {
+SearchServer::Query SearchServer::ParseQuery(const std::string_view& text) const {
     Query result;
     for (const std::string_view& word : SplitIntoWords(text)) {
         const auto query_word = ParseQueryWord(word);
@@ -260,22 +838,90 @@ SearchServer::Query SearchServer::ParseQuery(const std::string_view& text, bool
             }
             else {
                 result.plus_words.push_back(query_word.data);
+                if (query_word.is_required) {
+                    result.required_words.push_back(query_word.data);
+                }
             }
         }
     }
     
-    if (!is_not_sort) {
-        std::sort(std::execution::par, result.minus_words.begin(), result.minus_words.end());
-        std::sort(std::execution::par, result.plus_words.begin(), result.plus_words.end());
-        
-        result.minus_words.erase(std::unique(result.minus_words.begin(), result.minus_words.end()), result.minus_words.end());
-        result.plus_words.erase(std::unique(result.plus_words.begin(), result.plus_words.end()), result.plus_words.end());
-    }
+    // Queries hold a handful of words, a parallel sort only adds overhead here
+    std::sort(result.minus_words.begin(), result.minus_words.end());
+    std::sort(result.plus_words.begin(), result.plus_words.end());
+    std::sort(result.required_words.begin(), result.required_words.end());
+    
+    result.minus_words.erase(std::unique(result.minus_words.begin(), result.minus_words.end()), result.minus_words.end());
+    result.plus_words.erase(std::unique(result.plus_words.begin(), result.plus_words.end()), result.plus_words.end());
+    result.required_words.erase(std::unique(result.required_words.begin(), result.required_words.end()),
+                                result.required_words.end());
     
     return result;
 }
 
 
+SearchServer::ResolvedQuery SearchServer::ResolveQuery(const Query& query) const {
+    const auto resolve = [this] (const std::vector<std::string_view>& words) {
+        std::vector<int> term_ids;
+        term_ids.reserve(words.size());
+        for (const std::string_view word : words) {
+            const auto it = word_to_term_id_.find(word);
+            if (it != word_to_term_id_.end()) {
+                term_ids.push_back(it->second);
+            }
+        }
+        std::sort(term_ids.begin(), term_ids.end());
+        return term_ids;
+    };
+    
+    ResolvedQuery result{ resolve(query.plus_words), resolve(query.minus_words), resolve(query.required_words) };
+    result.has_unknown_required_word = result.required_term_ids.size() < query.required_words.size();
+    return result;
+}
+
+
+size_t SearchServer::CountDocuments(const StatusPostings& postings) {
+    size_t document_count = 0;
+    for (const auto& status_postings : postings) {
+        document_count += status_postings.size();
+    }
+    return document_count;
+}
+
+
 double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view& word) const {
-    return std::log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+    return std::log(GetDocumentCount() * 1.0 / CountDocuments(word_to_document_freqs_.at(word)));
+}
+
+
+double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view& word,
+                                                    const QueryStatistics* statistics) const {
+    if (statistics == nullptr) {
+        return ComputeWordInverseDocumentFreq(word);
+    }
+    const auto it = statistics->document_freqs.find(word);
+    if (it == statistics->document_freqs.end()) {
+        using namespace std::string_literals;
+        throw std::out_of_range("No statistics for word "s + std::string(word));
+    }
+    return std::log(statistics->document_count * 1.0 / it->second);
+}
+
+
+bool SearchServer::SearchContext::ShouldStop() {
+    if (is_interrupted) {
+        return true;
+    }
+    if (limits != nullptr
+        && (limits->cancellation.IsCancelled() || std::chrono::steady_clock::now() >= limits->deadline)) {
+        is_interrupted = true;
+    }
+    return is_interrupted;
+}
+
+
+bool SearchServer::HasAnyTerm(int document_id, const std::vector<int>& term_ids) const {
+    const std::vector<int>& document_term_ids = documents_.at(document_id).term_ids;
+    return std::any_of(term_ids.begin(), term_ids.end(), [&document_term_ids] (int term_id) {
+        return std::binary_search(document_term_ids.begin(), document_term_ids.end(), term_id);
+    });
 }
\ No newline at end of file
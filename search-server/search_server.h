@@ -3,6 +3,11 @@
 #include "document.h"
 #include "string_processing.h"
 #include "concurrent_map.h"
+#include "sorted_intersection.h"
+#include "stop_words.h"
+#include "roaring_bitmap.h"
+#include "radix_sort.h"
+#include "document_slot_map.h"
 
 #include <string>
 #include <vector>
@@ -12,22 +17,141 @@
 #include <stdexcept>
 #include <execution>
 #include <string_view>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <array>
+#include <optional>
+#include <functional>
+#include <utility>
+#include <unordered_map>
+#include <unordered_set>
+#include <numeric>
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 const double COMPARISON_LIMIT = 1e-6;
+// Below this number of query words the par MatchDocument runs sequentially
+const size_t MATCH_DOCUMENT_PARALLEL_THRESHOLD = 4096;
 
 using Match_Document = std::tuple<std::vector<std::string_view>, DocumentStatus>;
 
+// Corpus figures that define IDF. Servers holding parts of one corpus
+// merge their statistics so every part scores with the global values
+struct QueryStatistics {
+    int document_count = 0;
+    std::map<std::string, int, std::less<>> document_freqs;  // by plus word
+    
+    void Merge(const QueryStatistics& other);
+};
+
+using Deadline = std::chrono::steady_clock::time_point;
+
+// Copies share one flag, so a caller keeps a copy to cancel a running search
+class CancellationToken {
+public:
+    void Cancel() const;
+    bool IsCancelled() const;
+    
+private:
+    std::shared_ptr<std::atomic<bool>> is_cancelled_ = std::make_shared<std::atomic<bool>>(false);
+};
+
+struct SearchLimits {
+    Deadline deadline = Deadline::max();
+    CancellationToken cancellation;
+};
+
+struct PartialSearchResult {
+    std::vector<Document> documents;
+    // Set when the deadline or cancellation stopped the posting traversal,
+    // documents then hold the best ones among the postings visited
+    bool truncated = false;
+};
+
+// A document tokenized and validated without touching the index, so documents
+// can be prepared on several threads while one thread adds them
+struct PreparedDocument {
+    int id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    int rating = 0;
+    std::string content;
+    // Offset and size in content of every word except stop words, in text order
+    std::vector<std::pair<size_t, size_t>> words;
+};
+
+struct IndexOptions {
+    // Keeps no word -> frequency map per document: the forward data is rebuilt
+    // from the sorted term ids of the document and the postings when needed
+    bool compact_forward_index = false;
+    // Also keeps the postings of every word ordered by quantized term frequency,
+    // so top documents are found score-at-a-time from the heads of the lists
+    bool impact_ordered_postings = false;
+};
+
+// Estimated heap and node bytes held by each structure of a SearchServer
+struct IndexMemoryUsage {
+    size_t stop_words = 0;
+    size_t term_dictionary = 0;
+    size_t postings = 0;
+    size_t forward_index = 0;
+    size_t documents = 0;
+    size_t attributes = 0;
+    size_t filters = 0;
+    
+    size_t GetTotal() const;
+};
+
+// Orders documents by relevance, rating breaks near ties,
+// and keeps the first MAX_RESULT_DOCUMENT_COUNT
+template <typename ExecutionPolicy>
+void KeepTopDocuments(const ExecutionPolicy& execution_policy, std::vector<Document>& documents);
+
+// Relevance rounded to steps of COMPARISON_LIMIT in the high half and rating
+// in the low half, both inverted so that better documents get smaller keys
+uint64_t MakeDocumentOrderKey(const Document& document);
+
+// Orders documents by relevance rounded to COMPARISON_LIMIT, then by higher rating.
+// Unlike the near tie compare of KeepTopDocuments this is a total order,
+// documents with equal keys keep their input order
+template <typename ExecutionPolicy>
+void SortDocuments(const ExecutionPolicy& execution_policy, std::vector<Document>& documents);
+
 class SearchServer {
 public:
     template <typename StringContainer>
-    explicit SearchServer(const StringContainer& stop_words);
-    explicit SearchServer(const std::string& stop_words_text);
-    explicit SearchServer(const std::string_view& stop_words_text);
+    explicit SearchServer(const StringContainer& stop_words, const IndexOptions& options = {});
+    explicit SearchServer(const std::string& stop_words_text, const IndexOptions& options = {});
+    explicit SearchServer(const std::string_view& stop_words_text, const IndexOptions& options = {});
     
     void AddDocument(int document_id, const std::string_view document, DocumentStatus status,
         const std::vector<int>& ratings);
     
+    // Safe to call concurrently with any other method
+    PreparedDocument PrepareDocument(int document_id, const std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings) const;
+    void AddDocument(PreparedDocument document);
+    
+    // Tokenize with stop words known at compile time, so the stop word check is
+    // inlined into the tokenizer loop. The set must hold the stop words the server
+    // was constructed with, otherwise std::invalid_argument is thrown
+    template <size_t N>
+    PreparedDocument PrepareDocument(const StaticStopWordSet<N>& stop_words, int document_id,
+        const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) const;
+    template <size_t N>
+    void AddDocument(const StaticStopWordSet<N>& stop_words, int document_id, const std::string_view document,
+        DocumentStatus status, const std::vector<int>& ratings);
+    
+    // Replaces the text and attributes of a document, only postings of words
+    // added, dropped or changed in frequency or status are touched
+    void UpdateDocument(int document_id, const std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings);
+    // Postings are kept by status, so each word of the document moves its
+    // posting node to the new partition, nothing is retokenized or reallocated
+    void SetDocumentStatus(int document_id, DocumentStatus status);
+    void SetDocumentRating(int document_id, int rating);
+    
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(const std::string_view& raw_query, 
                                            DocumentPredicate document_predicate) const;
@@ -48,6 +172,81 @@ public:
     std::vector<Document> FindTopDocuments(const ExecutionPolicy& execution_policy, 
                                            const std::string_view& raw_query) const;
     
+    // Every matching document ordered by SortDocuments, ties by ascending id.
+    // The result is one contiguous buffer, large ones can be streamed with Paginate
+    template <typename DocumentPredicate>
+    std::vector<Document> FindAllDocuments(const std::string_view& raw_query, 
+                                           DocumentPredicate document_predicate) const;
+    template <typename DocumentPredicate, typename ExecutionPolicy>
+    std::vector<Document> FindAllDocuments(const ExecutionPolicy& execution_policy, 
+                                           const std::string_view& raw_query, 
+                                           DocumentPredicate document_predicate) const;
+    
+    std::vector<Document> FindAllDocuments(const std::string_view& raw_query, 
+                                           DocumentStatus status) const;
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindAllDocuments(const ExecutionPolicy& execution_policy, 
+                                           const std::string_view& raw_query, 
+                                           DocumentStatus status) const;
+    
+    std::vector<Document> FindAllDocuments(const std::string_view& raw_query) const;
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindAllDocuments(const ExecutionPolicy& execution_policy, 
+                                           const std::string_view& raw_query) const;
+    
+    // Top ACTUAL documents of every query in the order of raw_queries, equal to
+    // FindTopDocuments of each. Queries equal up to word order are evaluated once.
+    // Queries sharing words are evaluated in groups of up to BATCH_GROUP_SIZE that
+    // walk the postings of each word once, other queries one by one
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<std::string>& raw_queries) const;
+    
+    // Scores with IDF taken from statistics instead of this server alone
+    template <typename DocumentPredicate, typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& execution_policy, 
+                                           const std::string_view& raw_query, 
+                                           DocumentPredicate document_predicate,
+                                           const QueryStatistics& statistics) const;
+    
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& execution_policy, 
+                                           const std::string_view& raw_query, 
+                                           DocumentStatus status,
+                                           const QueryStatistics& statistics) const;
+    
+    QueryStatistics GetQueryStatistics(const std::string_view& raw_query) const;
+    
+    using DocumentFilter = std::function<bool(int document_id, DocumentStatus status, int rating)>;
+    
+    // The filter is evaluated once per document and kept as a bitmap of accepted ids,
+    // updated on every AddDocument and RemoveDocument. An existing name is replaced
+    void RegisterFilter(const std::string& name, DocumentFilter predicate);
+    void UnregisterFilter(const std::string_view& name);
+    
+    std::vector<Document> FindTopDocumentsWithFilter(const std::string_view& raw_query, 
+                                                     const std::string_view& filter_name) const;
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocumentsWithFilter(const ExecutionPolicy& execution_policy, 
+                                                     const std::string_view& raw_query, 
+                                                     const std::string_view& filter_name) const;
+    
+    // Stops traversing postings once the deadline passes or the search is cancelled
+    template <typename DocumentPredicate, typename ExecutionPolicy>
+    PartialSearchResult FindTopDocumentsWithin(const ExecutionPolicy& execution_policy, 
+                                               const std::string_view& raw_query, 
+                                               DocumentPredicate document_predicate,
+                                               const SearchLimits& limits) const;
+    
+    // Run FindTopDocumentsWithin on a separate thread, the server must outlive the future
+    template <typename DocumentPredicate>
+    std::future<PartialSearchResult> FindTopDocumentsAsync(const std::string_view& raw_query, 
+                                                           DocumentPredicate document_predicate,
+                                                           const SearchLimits& limits) const;
+    std::future<PartialSearchResult> FindTopDocumentsAsync(const std::string_view& raw_query, 
+                                                           DocumentStatus status,
+                                                           const SearchLimits& limits) const;
+    std::future<PartialSearchResult> FindTopDocumentsAsync(const std::string_view& raw_query, 
+                                                           const SearchLimits& limits) const;
+    
 
     int GetDocumentCount() const;
     
@@ -60,10 +259,26 @@ public:
                                  const std::string_view& raw_query, 
                                  int document_id) const;
     
+    // Parses the query once and matches it against every listed document,
+    // results follow the order of document_ids. Throws std::out_of_range
+    // before matching anything if one of the ids is unknown
+    std::vector<Match_Document> MatchDocuments(const std::string_view& raw_query,
+                                               const std::vector<int>& document_ids) const;
+    template <typename ExecutionPolicy>
+    std::vector<Match_Document> MatchDocuments(const ExecutionPolicy& execution_policy,
+                                               const std::string_view& raw_query,
+                                               const std::vector<int>& document_ids) const;
+    
     std::set<int>::const_iterator begin() const;
     std::set<int>::const_iterator end() const;
     
+    // With compact_forward_index the map is rebuilt from the postings on the first
+    // call and cached until the document is updated or removed
     const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    // Distinct words of the document, built from the forward index in either mode
+    std::set<std::string_view> GetDocumentWords(int document_id) const;
+    
+    IndexMemoryUsage GetMemoryUsage() const;
     
     void RemoveDocument(int document_id);
     void RemoveDocument(const std::execution::sequenced_policy&, int document_id);
@@ -72,39 +287,149 @@ public:
 private:
     struct DocumentData {
         std::string content;
-        int rating;
-        DocumentStatus status;
+        std::vector<int> term_ids;  // sorted forward index
+    };
+    // Postings of a word split by the status of documents, indexed by DocumentStatus
+    using StatusPostings = std::array<std::map<int, double>, DOCUMENT_STATUS_COUNT>;
+    
+    // Term frequencies are rounded up to 1..IMPACT_LEVELS, so impact / IMPACT_LEVELS
+    // bounds the frequency of every posting after it in the list
+    static constexpr int IMPACT_LEVELS = 255;
+    struct ImpactPosting {
+        int impact;
+        int document_id;
+        double term_freq;
+        
+        // Highest impact first, ids ascending within one impact
+        bool operator<(const ImpactPosting& other) const {
+            return impact != other.impact ? impact > other.impact : document_id < other.document_id;
+        }
     };
-    const std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
+    using ImpactPostings = std::array<std::set<ImpactPosting>, DOCUMENT_STATUS_COUNT>;
+    // Documents still able to reach the top that are rescored exactly
+    // once the impact ordered traversal stops
+    static constexpr size_t IMPACT_RESCORE_LIMIT = 64;
+    
+    const StopWordSet stop_words_;
+    const IndexOptions options_;
+    std::map<std::string, int, std::less<>> word_to_term_id_;
+    std::vector<std::string_view> term_id_to_word_;
+    std::map<std::string_view, StatusPostings> word_to_document_freqs_;
+    std::map<std::string_view, ImpactPostings> word_to_impact_postings_;  // with impact_ordered_postings
+    // Ids of the documents holding each term whatever their status, by term id,
+    // intersected with filters
+    std::vector<RoaringBitmap> term_id_to_document_ids_;
     std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
+    // Maps rebuilt by GetWordFrequencies with compact_forward_index
+    mutable std::map<int, std::map<std::string_view, double>> word_freqs_cache_;
+    mutable std::mutex word_freqs_cache_mutex_;
     std::map<int, DocumentData> documents_;
     std::set<int> document_ids_;
+    // Attributes stored by columns indexed by a dense slot of the document,
+    // so sparse ids cost nothing; slots of removed documents are reused
+    DocumentSlotMap document_slots_;
+    std::vector<uint32_t> free_slots_;
+    std::vector<DocumentStatus> document_statuses_;
+    std::vector<int> document_ratings_;
+    
+    uint32_t AcquireDocumentSlot(int document_id);
+    void ReleaseDocumentSlot(int document_id);
+    DocumentStatus GetDocumentStatus(int document_id) const;
+    int GetDocumentRating(int document_id) const;
+    
+    struct NamedFilter {
+        DocumentFilter predicate;
+        RoaringBitmap document_ids;
+    };
+    std::map<std::string, NamedFilter, std::less<>> filters_;
+    
+    // Brings the membership of the document in every filter up to date
+    void RefreshFilters(int document_id);
     
     bool IsStopWord(const std::string_view word) const;
     static bool IsValidWord(const std::string_view word);
     
-    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view& text) const;
+    template <typename StopWords>
+    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view& text,
+                                                       const StopWords& stop_words) const;
+    template <typename StopWords>
+    PreparedDocument PrepareDocumentWith(const StopWords& stop_words, int document_id,
+        const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) const;
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
+    
+    int GetOrCreateTermId(const std::string_view word);
+    
+    static int QuantizeImpact(double term_freq);
+    // Frequency of every distinct word of the document by term id, summed
+    // per occurrence so that repeated indexing gives identical values
+    std::map<int, double> ComputeTermFreqs(const PreparedDocument& document);
+    void InsertPosting(int term_id, size_t status, int document_id, double term_freq);
+    // Drops the document from the postings of the term, status is the one it was indexed with
+    void ErasePosting(int term_id, size_t status, int document_id);
+    void MovePosting(int term_id, size_t old_status, size_t new_status, int document_id);
 
     struct QueryWord {
         std::string_view data;
         bool is_minus;
+        bool is_required;
         bool is_stop;
     };
     
     QueryWord ParseQueryWord(const std::string_view& text) const;
 
+    // A plus word written as +word is also required: only documents
+    // containing every required word match, other plus words add to their relevance
     struct Query {
         std::vector<std::string_view> plus_words;
         std::vector<std::string_view> minus_words;
+        std::vector<std::string_view> required_words;
+    };
+    
+    Query ParseQuery(const std::string_view& text) const;
+    
+    // Query words translated to term ids, unknown words are dropped
+    struct ResolvedQuery {
+        std::vector<int> plus_term_ids;
+        std::vector<int> minus_term_ids;
+        std::vector<int> required_term_ids;
+        bool has_unknown_required_word = false;
     };
     
-    Query ParseQuery(const std::string_view& text, bool is_not_sort = false) const;
+    ResolvedQuery ResolveQuery(const Query& query) const;
+    
+    template <typename ExecutionPolicy>
+    Match_Document MatchResolvedQuery(const ExecutionPolicy& execution_policy,
+                                      const ResolvedQuery& query,
+                                      int document_id) const;
 
+    static size_t CountDocuments(const StatusPostings& postings);
+    
     // Existence required
     double ComputeWordInverseDocumentFreq(const std::string_view& word) const;
+    double ComputeWordInverseDocumentFreq(const std::string_view& word,
+                                          const QueryStatistics* statistics) const;
+
+    // Optional inputs of one search and the state of its interruption
+    struct SearchContext {
+        const QueryStatistics* statistics = nullptr;
+        const SearchLimits* limits = nullptr;
+        // Only postings of documents with this status are traversed
+        std::optional<DocumentStatus> status;
+        // Only postings of these documents are scored
+        const RoaringBitmap* filter = nullptr;
+        std::atomic<bool> is_interrupted = false;
+        
+        bool ShouldStop();
+    };
+    
+    // Postings visited between two checks of the search limits
+    static constexpr size_t LIMITS_CHECK_INTERVAL = 1024;
+    // A filter accepting at most this share of the documents is intersected with the
+    // id sets of the words and only common documents are looked up in the postings.
+    // A lookup costs several steps of a posting walk, so larger filters are checked
+    // against every posting walked instead
+    static constexpr double FILTER_INTERSECTION_MAX_SHARE = 0.25;
 
     template <typename DocumentPredicate>
     std::vector<Document> FindAllDocuments(const Query& query, 
@@ -113,12 +438,62 @@ private:
     std::vector<Document> FindAllDocuments(const ExecutionPolicy& execution_policy, 
                                            const Query& query, 
                                            DocumentPredicate document_predicate) const;
+    template <typename DocumentPredicate, typename ExecutionPolicy>
+    std::vector<Document> FindAllDocuments(const ExecutionPolicy& execution_policy, 
+                                           const Query& query, 
+                                           DocumentPredicate document_predicate,
+                                           SearchContext& context) const;
+    
+    // Score-at-a-time traversal of the impact ordered postings: segments of equal impact
+    // are visited by decreasing bound and the traversal stops as soon as the documents
+    // not yet collected can no longer reach the top. The top is then rescored exactly
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsByImpact(const Query& query, 
+                                                   DocumentPredicate document_predicate,
+                                                   std::optional<DocumentStatus> status) const;
+    
+    // Intersects the postings of the required words rarest first, then scores
+    // only the documents found in all of them
+    template <typename DocumentPredicate, typename ExecutionPolicy>
+    std::vector<Document> FindConjunctiveDocuments(const ExecutionPolicy& execution_policy, 
+                                                   const Query& query, 
+                                                   DocumentPredicate document_predicate,
+                                                   SearchContext& context) const;
+    
+    bool HasAnyTerm(int document_id, const std::vector<int>& term_ids) const;
+    
+    // Queries of a FindTopDocumentsBatch group, the memory taken by a group
+    // and the work lost when a group is split across threads grow with it
+    static constexpr size_t BATCH_GROUP_SIZE = 16;
+    // Postings of the longest word of a group per range of ids it is split into
+    static constexpr size_t BATCH_RANGE_POSTINGS = 2048;
+    struct BatchWord {
+        const std::map<int, double>* postings;
+        double inverse_document_freq;
+        std::vector<size_t> members;  // positions of the queries containing it in the group
+    };
+    
+    // Walks the postings of the words in ids [range_begin, range_end) document
+    // at a time, adding every document to the matches of the members it scores for
+    void ScoreBatchGroup(const std::vector<BatchWord>& words, int range_begin, std::optional<int> range_end,
+                         std::vector<std::vector<Document>>& member_matches) const;
 };
 
 
+// Looked up for every posting during the search, so defined inline
+inline DocumentStatus SearchServer::GetDocumentStatus(int document_id) const {
+    return document_statuses_[document_slots_.At(document_id)];
+}
+
+inline int SearchServer::GetDocumentRating(int document_id) const {
+    return document_ratings_[document_slots_.At(document_id)];
+}
+
+
 template <typename StringContainer>
-SearchServer::SearchServer(const StringContainer& stop_words)
-    : stop_words_(MakeUniqueNonEmptyStrings(stop_words))  // Extract non-empty stop words
+SearchServer::SearchServer(const StringContainer& stop_words, const IndexOptions& options)
+    : stop_words_(StopWordSet(MakeUniqueNonEmptyStrings(stop_words)))  // Extract non-empty stop words
+    , options_(options)
 {
     using namespace std::string_literals;
     if (!std::all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
@@ -127,44 +502,257 @@ SearchServer::SearchServer(const StringContainer& stop_words)
 }
 
 
+template <size_t N>
+PreparedDocument SearchServer::PrepareDocument(const StaticStopWordSet<N>& stop_words, int document_id,
+    const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) const {
+    if (stop_words.GetFingerprint() != stop_words_.GetFingerprint()) {
+        using namespace std::string_literals;
+        throw std::invalid_argument("Stop words differ from those of the server"s);
+    }
+    return PrepareDocumentWith(stop_words, document_id, document, status, ratings);
+}
+
+template <size_t N>
+void SearchServer::AddDocument(const StaticStopWordSet<N>& stop_words, int document_id,
+    const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+    AddDocument(PrepareDocument(stop_words, document_id, document, status, ratings));
+}
+
+template <typename StopWords>
+PreparedDocument SearchServer::PrepareDocumentWith(const StopWords& stop_words, int document_id,
+    const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) const {
+    if (document_id < 0) {
+        using namespace std::string_literals;
+        throw std::invalid_argument("Invalid document_id"s);
+    }
+    
+    PreparedDocument prepared{ document_id, status, ComputeAverageRating(ratings), std::string(document), {} };
+    for (const std::string_view word : SplitIntoWordsNoStop(prepared.content, stop_words)) {
+        prepared.words.emplace_back(word.data() - prepared.content.data(), word.size());
+    }
+    return prepared;
+}
+
+template <typename StopWords>
+std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view& text,
+                                                                 const StopWords& stop_words) const {
+    std::vector<std::string_view> words;
+    for (const std::string_view& word : SplitIntoWords(text)) {
+        if (!IsValidWord(word)) {
+            using namespace std::string_literals;
+            throw std::invalid_argument("Word "s + std::string(word) + " is invalid"s);
+        }
+        if (!stop_words.count(word)) {
+            words.push_back(word);
+        }
+    }
+    return words;
+}
+
+
+template <typename ExecutionPolicy>
+void KeepTopDocuments(const ExecutionPolicy& execution_policy, std::vector<Document>& documents) {
+    std::sort(execution_policy, 
+         documents.begin(), documents.end(),
+         [](const Document& lhs, const Document& rhs) {
+             if (std::abs(lhs.relevance - rhs.relevance) < COMPARISON_LIMIT) {
+                 return lhs.rating > rhs.rating;
+             }
+             else {
+                 return lhs.relevance > rhs.relevance;
+             }
+         });
+    if (documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
+        documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    }
+}
+
+template <typename ExecutionPolicy>
+void SortDocuments(const ExecutionPolicy& execution_policy, std::vector<Document>& documents) {
+    std::vector<uint64_t> keys(documents.size());
+    std::transform(execution_policy,
+                   documents.begin(), documents.end(),
+                   keys.begin(),
+                   MakeDocumentOrderKey);
+    // Positions are moved through the passes instead of whole documents
+    std::vector<uint32_t> order(documents.size());
+    std::iota(order.begin(), order.end(), 0);
+    RadixSortByKeys(execution_policy, keys, order);
+    
+    std::vector<Document> sorted_documents(documents.size());
+    std::transform(execution_policy,
+                   order.begin(), order.end(),
+                   sorted_documents.begin(),
+                   [&documents] (uint32_t position) { return documents[position]; });
+    documents.swap(sorted_documents);
+}
+
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query, 
                                                      DocumentPredicate document_predicate) const {
     return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
 }
+
 template <typename DocumentPredicate, typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& execution_policy, 
                                                      const std::string_view& raw_query, 
                                                      DocumentPredicate document_predicate) const {
     const auto query = ParseQuery(raw_query);
+    if (options_.impact_ordered_postings && query.required_words.empty()) {
+        return FindTopDocumentsByImpact(query, document_predicate, std::nullopt);
+    }
     
     auto matched_documents = FindAllDocuments(execution_policy, query, document_predicate);
+    KeepTopDocuments(execution_policy, matched_documents);
     
-    std::sort(execution_policy, 
-         matched_documents.begin(), matched_documents.end(),
-         [](const Document& lhs, const Document& rhs) {
-             if (std::abs(lhs.relevance - rhs.relevance) < COMPARISON_LIMIT) {
-                 return lhs.rating > rhs.rating;
-             }
-             else {
-                 return lhs.relevance > rhs.relevance;
-             }
-         });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    return matched_documents;
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindAllDocuments(const std::string_view& raw_query, 
+                                                     DocumentPredicate document_predicate) const {
+    return FindAllDocuments(std::execution::seq, raw_query, document_predicate);
+}
+
+template <typename DocumentPredicate, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindAllDocuments(const ExecutionPolicy& execution_policy, 
+                                                     const std::string_view& raw_query, 
+                                                     DocumentPredicate document_predicate) const {
+    const auto query = ParseQuery(raw_query);
+    
+    auto matched_documents = FindAllDocuments(execution_policy, query, document_predicate);
+    SortDocuments(execution_policy, matched_documents);
+    
+    return matched_documents;
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindAllDocuments(const ExecutionPolicy& execution_policy, 
+                                                     const std::string_view& raw_query, 
+                                                     DocumentStatus status) const {
+    const auto query = ParseQuery(raw_query);
+    
+    SearchContext context;
+    context.status = status;
+    auto matched_documents = FindAllDocuments(execution_policy, query,
+        [](int document_id, DocumentStatus document_status, int rating) {
+            return true;
+        }, context);
+    SortDocuments(execution_policy, matched_documents);
+    
+    return matched_documents;
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindAllDocuments(const ExecutionPolicy& execution_policy, 
+                                                     const std::string_view& raw_query) const {
+    return FindAllDocuments(execution_policy, raw_query, DocumentStatus::ACTUAL);
+}
+
+template <typename DocumentPredicate, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& execution_policy, 
+                                                     const std::string_view& raw_query, 
+                                                     DocumentPredicate document_predicate,
+                                                     const QueryStatistics& statistics) const {
+    const auto query = ParseQuery(raw_query);
+    
+    SearchContext context;
+    context.statistics = &statistics;
+    auto matched_documents = FindAllDocuments(execution_policy, query, document_predicate, context);
+    KeepTopDocuments(execution_policy, matched_documents);
+    
+    return matched_documents;
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& execution_policy, 
+                                                     const std::string_view& raw_query, 
+                                                     DocumentStatus status,
+                                                     const QueryStatistics& statistics) const {
+    const auto query = ParseQuery(raw_query);
+    
+    SearchContext context;
+    context.statistics = &statistics;
+    context.status = status;
+    auto matched_documents = FindAllDocuments(execution_policy, query,
+        [](int document_id, DocumentStatus document_status, int rating) {
+            return true;
+        }, context);
+    KeepTopDocuments(execution_policy, matched_documents);
+    
+    return matched_documents;
+}
+
+template <typename DocumentPredicate, typename ExecutionPolicy>
+PartialSearchResult SearchServer::FindTopDocumentsWithin(const ExecutionPolicy& execution_policy, 
+                                                         const std::string_view& raw_query, 
+                                                         DocumentPredicate document_predicate,
+                                                         const SearchLimits& limits) const {
+    const auto query = ParseQuery(raw_query);
+    
+    SearchContext context;
+    context.limits = &limits;
+    PartialSearchResult result;
+    result.documents = FindAllDocuments(execution_policy, query, document_predicate, context);
+    result.truncated = context.is_interrupted;
+    KeepTopDocuments(execution_policy, result.documents);
+    
+    return result;
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocumentsWithFilter(const ExecutionPolicy& execution_policy, 
+                                                               const std::string_view& raw_query, 
+                                                               const std::string_view& filter_name) const {
+    const auto filter_it = filters_.find(filter_name);
+    if (filter_it == filters_.end()) {
+        using namespace std::string_literals;
+        throw std::invalid_argument("Unknown filter "s + std::string(filter_name));
     }
+    const auto query = ParseQuery(raw_query);
+    
+    SearchContext context;
+    context.filter = &filter_it->second.document_ids;
+    auto matched_documents = FindAllDocuments(execution_policy, query,
+        [](int document_id, DocumentStatus document_status, int rating) {
+            return true;
+        }, context);
+    KeepTopDocuments(execution_policy, matched_documents);
     
     return matched_documents;
 }
 
+template <typename DocumentPredicate>
+std::future<PartialSearchResult> SearchServer::FindTopDocumentsAsync(const std::string_view& raw_query, 
+                                                                     DocumentPredicate document_predicate,
+                                                                     const SearchLimits& limits) const {
+    return std::async(std::launch::async,
+        [this, query = std::string(raw_query), document_predicate, limits] {
+            return FindTopDocumentsWithin(std::execution::seq, query, document_predicate, limits);
+        });
+}
+
 template <typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& execution_policy, 
                                                      const std::string_view& raw_query, 
                                                      DocumentStatus status) const {
-    return FindTopDocuments(execution_policy, 
-        raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-            return document_status == status;
-        });
+    const auto query = ParseQuery(raw_query);
+    if (options_.impact_ordered_postings && query.required_words.empty()) {
+        return FindTopDocumentsByImpact(query,
+            [](int document_id, DocumentStatus document_status, int rating) {
+                return true;
+            }, status);
+    }
+    
+    SearchContext context;
+    context.status = status;
+    auto matched_documents = FindAllDocuments(execution_policy, query,
+        [](int document_id, DocumentStatus document_status, int rating) {
+            return true;
+        }, context);
+    KeepTopDocuments(execution_policy, matched_documents);
+    
+    return matched_documents;
 }
 
 template <typename ExecutionPolicy>
@@ -182,19 +770,71 @@ template <typename DocumentPredicate, typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindAllDocuments(const ExecutionPolicy& execution_policy, 
                                                      const Query& query, 
                                                      DocumentPredicate document_predicate) const {
+    SearchContext context;
+    return FindAllDocuments(execution_policy, query, document_predicate, context);
+}
+template <typename DocumentPredicate, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindAllDocuments(const ExecutionPolicy& execution_policy, 
+                                                     const Query& query, 
+                                                     DocumentPredicate document_predicate,
+                                                     SearchContext& context) const {
+    if (!query.required_words.empty()) {
+        return FindConjunctiveDocuments(execution_policy, query, document_predicate, context);
+    }
+    
     const size_t QUANTITY_BUKETS = 8;
     ConcurrentMap<int, double> document_to_relevance_concurrent_map(QUANTITY_BUKETS);
     
+    std::vector<size_t> statuses;
+    if (context.status) {
+        statuses.push_back(static_cast<size_t>(*context.status));
+    }
+    else {
+        for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+            statuses.push_back(status);
+        }
+    }
+    
+    const bool is_filter_intersected = context.filter != nullptr
+        && context.filter->GetCardinality() <= FILTER_INTERSECTION_MAX_SHARE * documents_.size();
+    
     const auto function_for_plus_words = [&] (std::string_view word) {
-        if (word_to_document_freqs_.count(word) == 0) {
+        const auto word_it = word_to_document_freqs_.find(word);
+        if (word_it == word_to_document_freqs_.end() || context.ShouldStop()) {
             return;
         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
+        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word, context.statistics);
+        size_t visited_count = 0;
+        const auto add_posting = [&] (int document_id, DocumentStatus status, double term_freq) {
+            if (document_predicate(document_id, status, GetDocumentRating(document_id))) {
                 document_to_relevance_concurrent_map[document_id].ref_to_value += term_freq * inverse_document_freq;
             }
+        };
+        
+        if (is_filter_intersected) {
+            const RoaringBitmap& document_ids = term_id_to_document_ids_[word_to_term_id_.find(word)->second];
+            document_ids.ForEachCommonValue(*context.filter, [&] (uint32_t value) {
+                if (++visited_count % LIMITS_CHECK_INTERVAL == 0 && context.ShouldStop()) {
+                    return false;
+                }
+                const int document_id = static_cast<int>(value);
+                const DocumentStatus status = GetDocumentStatus(document_id);
+                if (!context.status || *context.status == status) {
+                    add_posting(document_id, status, word_it->second[static_cast<size_t>(status)].at(document_id));
+                }
+                return true;
+            });
+            return;
+        }
+        for (const size_t status : statuses) {
+            for (const auto [document_id, term_freq] : word_it->second[status]) {
+                if (++visited_count % LIMITS_CHECK_INTERVAL == 0 && context.ShouldStop()) {
+                    return;
+                }
+                if (context.filter == nullptr || context.filter->Contains(document_id)) {
+                    add_posting(document_id, static_cast<DocumentStatus>(status), term_freq);
+                }
+            }
         }
     };
     
@@ -202,11 +842,30 @@ std::vector<Document> SearchServer::FindAllDocuments(const ExecutionPolicy& exec
                   query.plus_words.end(), function_for_plus_words);
     
     const auto function_for_minus_words = [&] (std::string_view word) {
-        if (word_to_document_freqs_.count(word) == 0) {
+        const auto word_it = word_to_document_freqs_.find(word);
+        if (word_it == word_to_document_freqs_.end() || context.is_interrupted) {
             return;
         }
-        for (const auto& [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance_concurrent_map.erase(document_id);
+        size_t visited_count = 0;
+        // Documents outside the filter were never collected
+        if (context.filter != nullptr) {
+            const RoaringBitmap& document_ids = term_id_to_document_ids_[word_to_term_id_.find(word)->second];
+            document_ids.ForEachCommonValue(*context.filter, [&] (uint32_t value) {
+                if (++visited_count % LIMITS_CHECK_INTERVAL == 0 && context.ShouldStop()) {
+                    return false;
+                }
+                document_to_relevance_concurrent_map.erase(static_cast<int>(value));
+                return true;
+            });
+            return;
+        }
+        for (const size_t status : statuses) {
+            for (const auto& [document_id, _] : word_it->second[status]) {
+                if (++visited_count % LIMITS_CHECK_INTERVAL == 0 && context.ShouldStop()) {
+                    return;
+                }
+                document_to_relevance_concurrent_map.erase(document_id);
+            }
         }
     };
     
@@ -215,10 +874,362 @@ std::vector<Document> SearchServer::FindAllDocuments(const ExecutionPolicy& exec
     
     std::map<int, double> document_to_relevance = document_to_relevance_concurrent_map.BuildOrdinaryMap();
     
+    // An interrupted traversal may have skipped minus postings,
+    // the collected documents are checked against the forward index instead
+    std::vector<int> minus_term_ids;
+    if (context.is_interrupted) {
+        minus_term_ids = ResolveQuery(query).minus_term_ids;
+    }
+    
     std::vector<Document> matched_documents;
     for (const auto& [document_id, relevance] : document_to_relevance) {
+        if (!minus_term_ids.empty() && HasAnyTerm(document_id, minus_term_ids)) {
+            continue;
+        }
         matched_documents.push_back(
-            { document_id, relevance, documents_.at(document_id).rating });
+            { document_id, relevance, GetDocumentRating(document_id) });
+    }
+    return matched_documents;
+}
+
+template <typename DocumentPredicate, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindConjunctiveDocuments(const ExecutionPolicy& execution_policy, 
+                                                             const Query& query, 
+                                                             DocumentPredicate document_predicate,
+                                                             SearchContext& context) const {
+    std::vector<const StatusPostings*> required_postings;
+    for (const std::string_view word : query.required_words) {
+        const auto word_it = word_to_document_freqs_.find(word);
+        if (word_it == word_to_document_freqs_.end()) {
+            return {};
+        }
+        required_postings.push_back(&word_it->second);
+    }
+    
+    std::vector<int> document_ids;
+    size_t visited_count = 0;
+    for (size_t status = 0; status < DOCUMENT_STATUS_COUNT && !context.ShouldStop(); ++status) {
+        if (context.status && static_cast<size_t>(*context.status) != status) {
+            continue;
+        }
+        std::vector<const std::map<int, double>*> lists;
+        for (const StatusPostings* postings : required_postings) {
+            lists.push_back(&(*postings)[status]);
+        }
+        std::sort(lists.begin(), lists.end(), [](const auto* lhs, const auto* rhs) {
+            return lhs->size() < rhs->size();
+        });
+        
+        // Every list jumps to the candidate of the rarest one, a list ahead
+        // of the candidate moves the rarest list forward to its position
+        std::vector<std::map<int, double>::const_iterator> cursors;
+        for (const auto* list : lists) {
+            cursors.push_back(list->begin());
+        }
+        while (cursors[0] != lists[0]->end()) {
+            if (++visited_count % LIMITS_CHECK_INTERVAL == 0 && context.ShouldStop()) {
+                break;
+            }
+            const int candidate_id = cursors[0]->first;
+            bool is_in_all = true;
+            for (size_t i = 1; i < lists.size(); ++i) {
+                if (cursors[i] != lists[i]->end() && cursors[i]->first < candidate_id) {
+                    cursors[i] = lists[i]->lower_bound(candidate_id);
+                }
+                if (cursors[i] == lists[i]->end()) {
+                    cursors[0] = lists[0]->end();
+                    is_in_all = false;
+                    break;
+                }
+                if (cursors[i]->first > candidate_id) {
+                    cursors[0] = lists[0]->lower_bound(cursors[i]->first);
+                    is_in_all = false;
+                    break;
+                }
+            }
+            if (!is_in_all) {
+                continue;
+            }
+            if ((context.filter == nullptr || context.filter->Contains(candidate_id))
+                && document_predicate(candidate_id, static_cast<DocumentStatus>(status),
+                                      GetDocumentRating(candidate_id))) {
+                document_ids.push_back(candidate_id);
+            }
+            ++cursors[0];
+        }
+    }
+    std::sort(document_ids.begin(), document_ids.end());
+    
+    std::vector<double> inverse_document_freqs;
+    std::vector<const StatusPostings*> plus_postings;
+    for (const std::string_view word : query.plus_words) {
+        const auto word_it = word_to_document_freqs_.find(word);
+        if (word_it != word_to_document_freqs_.end()) {
+            inverse_document_freqs.push_back(ComputeWordInverseDocumentFreq(word, context.statistics));
+            plus_postings.push_back(&word_it->second);
+        }
+    }
+    const std::vector<int> minus_term_ids = ResolveQuery(query).minus_term_ids;
+    
+    std::vector<Document> matched_documents(document_ids.size());
+    std::transform(execution_policy,
+                   document_ids.begin(), document_ids.end(),
+                   matched_documents.begin(),
+                   [&] (int document_id) {
+                       const size_t status = static_cast<size_t>(GetDocumentStatus(document_id));
+                       double relevance = 0.0;
+                       for (size_t i = 0; i < plus_postings.size(); ++i) {
+                           const auto& postings = (*plus_postings[i])[status];
+                           const auto posting_it = postings.find(document_id);
+                           if (posting_it != postings.end()) {
+                               relevance += posting_it->second * inverse_document_freqs[i];
+                           }
+                       }
+                       return Document{ document_id, relevance, GetDocumentRating(document_id) };
+                   });
+    
+    if (!minus_term_ids.empty()) {
+        matched_documents.erase(
+            std::remove_if(matched_documents.begin(), matched_documents.end(),
+                           [&] (const Document& document) {
+                               return HasAnyTerm(document.id, minus_term_ids);
+                           }),
+            matched_documents.end());
+    }
+    return matched_documents;
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsByImpact(const Query& query, 
+                                                             DocumentPredicate document_predicate,
+                                                             std::optional<DocumentStatus> status) const {
+    struct Cursor {
+        std::set<ImpactPosting>::const_iterator posting_it;
+        std::set<ImpactPosting>::const_iterator postings_end;
+        size_t word_index;
+        double inverse_document_freq;
+        
+        bool IsExhausted() const {
+            return posting_it == postings_end;
+        }
+        // Largest contribution of any posting left in the list
+        double GetBound() const {
+            return IsExhausted() ? 0.0 : posting_it->impact * inverse_document_freq / IMPACT_LEVELS;
+        }
+    };
+    
+    // Partial relevance of a collected document and the query words already added to it.
+    // Words past the width of the mask are never marked, which only loosens the bound
+    struct Accumulator {
+        double relevance = 0.0;
+        uint64_t added_words = 0;
+        bool is_top = false;  // among the result_count largest partial relevances
+    };
+    const size_t MASK_WIDTH = 64;
+    
+    std::vector<double> inverse_document_freqs(query.plus_words.size(), 0.0);
+    std::vector<Cursor> cursors;
+    for (size_t word_index = 0; word_index < query.plus_words.size(); ++word_index) {
+        const auto word_it = word_to_impact_postings_.find(query.plus_words[word_index]);
+        if (word_it == word_to_impact_postings_.end()) {
+            continue;
+        }
+        inverse_document_freqs[word_index] = ComputeWordInverseDocumentFreq(word_it->first);
+        for (size_t list_status = 0; list_status < DOCUMENT_STATUS_COUNT; ++list_status) {
+            const auto& postings = word_it->second[list_status];
+            if ((!status || static_cast<size_t>(*status) == list_status) && !postings.empty()) {
+                cursors.push_back({ postings.begin(), postings.end(), word_index, inverse_document_freqs[word_index] });
+            }
+        }
+    }
+    const std::vector<int> minus_term_ids = ResolveQuery(query).minus_term_ids;
+    const size_t result_count = MAX_RESULT_DOCUMENT_COUNT;
+    
+    std::unordered_map<int, Accumulator> accumulators;
+    std::unordered_set<int> rejected_document_ids;
+    // A document lies in one status list per word, so what a word can still add
+    // is the largest bound among its lists
+    std::vector<double> word_bounds(query.plus_words.size());
+    // Partial relevances only grow, so the smallest of the result_count largest
+    // ones, the k-th relevance, only grows as well
+    std::set<std::pair<double, int>> top_partials;
+    std::vector<int> candidate_ids;
+    // Candidates are recounted only after as many postings as there are
+    // accumulators, which keeps the counting linear in the traversed postings
+    size_t traversed_posting_count = 0;
+    size_t next_count_posting_count = 0;
+    
+    const auto compute_upper_bound = [&word_bounds] (const Accumulator& accumulator) {
+        double bound = accumulator.relevance;
+        for (size_t word_index = 0; word_index < word_bounds.size(); ++word_index) {
+            if (word_index >= MASK_WIDTH || (accumulator.added_words >> word_index & 1) == 0) {
+                bound += word_bounds[word_index];
+            }
+        }
+        return bound;
+    };
+    
+    while (true) {
+        std::fill(word_bounds.begin(), word_bounds.end(), 0.0);
+        Cursor* next_cursor = nullptr;
+        for (Cursor& cursor : cursors) {
+            if (cursor.IsExhausted()) {
+                continue;
+            }
+            word_bounds[cursor.word_index] = std::max(word_bounds[cursor.word_index], cursor.GetBound());
+            if (next_cursor == nullptr || cursor.GetBound() > next_cursor->GetBound()) {
+                next_cursor = &cursor;
+            }
+        }
+        if (next_cursor == nullptr) {
+            break;
+        }
+        
+        // Safe to stop when a document not collected yet cannot reach the current k-th
+        // partial relevance and few collected documents still can
+        const double remaining_bound = std::accumulate(word_bounds.begin(), word_bounds.end(), 0.0);
+        if (top_partials.size() == result_count && traversed_posting_count >= next_count_posting_count) {
+            const double kth_relevance = top_partials.begin()->first;
+            if (remaining_bound < kth_relevance - COMPARISON_LIMIT) {
+                const size_t candidate_count = std::count_if(accumulators.begin(), accumulators.end(),
+                    [&] (const auto& document) {
+                        return compute_upper_bound(document.second) >= kth_relevance - COMPARISON_LIMIT;
+                    });
+                if (candidate_count <= IMPACT_RESCORE_LIMIT) {
+                    break;
+                }
+                next_count_posting_count = traversed_posting_count + accumulators.size();
+            }
+        }
+        
+        const int impact = next_cursor->posting_it->impact;
+        const uint64_t word_bit = next_cursor->word_index < MASK_WIDTH ? uint64_t(1) << next_cursor->word_index : 0;
+        for (; !next_cursor->IsExhausted() && next_cursor->posting_it->impact == impact; ++next_cursor->posting_it) {
+            const int document_id = next_cursor->posting_it->document_id;
+            auto accumulator_it = accumulators.find(document_id);
+            if (accumulator_it == accumulators.end()) {
+                if (rejected_document_ids.count(document_id) > 0) {
+                    continue;
+                }
+                if (!document_predicate(document_id, GetDocumentStatus(document_id), GetDocumentRating(document_id))
+                    || (!minus_term_ids.empty() && HasAnyTerm(document_id, minus_term_ids))) {
+                    rejected_document_ids.insert(document_id);
+                    continue;
+                }
+                accumulator_it = accumulators.emplace(document_id, Accumulator{}).first;
+            }
+            Accumulator& accumulator = accumulator_it->second;
+            if (accumulator.is_top) {
+                top_partials.erase({ accumulator.relevance, document_id });
+            }
+            accumulator.relevance += next_cursor->posting_it->term_freq * next_cursor->inverse_document_freq;
+            accumulator.added_words |= word_bit;
+            ++traversed_posting_count;
+            
+            if (!accumulator.is_top && top_partials.size() == result_count) {
+                const auto [min_relevance, min_document_id] = *top_partials.begin();
+                if (accumulator.relevance <= min_relevance) {
+                    continue;
+                }
+                top_partials.erase(top_partials.begin());
+                accumulators.at(min_document_id).is_top = false;
+            }
+            top_partials.emplace(accumulator.relevance, document_id);
+            accumulator.is_top = true;
+        }
+    }
+    
+    // Documents that may still rank among the top or tie with it are rescored
+    // in query word order, giving the same sums as the full evaluation
+    const double kth_relevance = top_partials.size() == result_count ? top_partials.begin()->first : 0.0;
+    for (const auto& [document_id, accumulator] : accumulators) {
+        if (compute_upper_bound(accumulator) >= kth_relevance - COMPARISON_LIMIT) {
+            candidate_ids.push_back(document_id);
+        }
+    }
+    std::sort(candidate_ids.begin(), candidate_ids.end());
+    
+    std::vector<Document> matched_documents;
+    for (const int document_id : candidate_ids) {
+        const size_t document_status = static_cast<size_t>(GetDocumentStatus(document_id));
+        double relevance = 0.0;
+        for (size_t word_index = 0; word_index < query.plus_words.size(); ++word_index) {
+            const auto word_it = word_to_document_freqs_.find(query.plus_words[word_index]);
+            if (word_it == word_to_document_freqs_.end()) {
+                continue;
+            }
+            const auto& postings = word_it->second[document_status];
+            const auto posting_it = postings.find(document_id);
+            if (posting_it != postings.end()) {
+                relevance += posting_it->second * inverse_document_freqs[word_index];
+            }
+        }
+        matched_documents.push_back({ document_id, relevance, GetDocumentRating(document_id) });
     }
+    KeepTopDocuments(std::execution::seq, matched_documents);
+    
     return matched_documents;
-}
\ No newline at end of file
+}
+
+template <typename ExecutionPolicy>
+std::vector<Match_Document> SearchServer::MatchDocuments(const ExecutionPolicy& execution_policy,
+                                                         const std::string_view& raw_query,
+                                                         const std::vector<int>& document_ids) const {
+    const ResolvedQuery query = ResolveQuery(ParseQuery(raw_query));
+    // An exception escaping the transform would terminate the program under any policy
+    for (const int document_id : document_ids) {
+        if (documents_.count(document_id) == 0) {
+            using namespace std::string_literals;
+            throw std::out_of_range("Unknown document_id "s + std::to_string(document_id));
+        }
+    }
+    
+    std::vector<Match_Document> result(document_ids.size());
+    std::transform(execution_policy,
+                   document_ids.begin(), document_ids.end(),
+                   result.begin(),
+                   [this, &query] (int document_id) {
+                       return MatchResolvedQuery(std::execution::seq, query, document_id);
+                   });
+    return result;
+}
+
+template <typename ExecutionPolicy>
+Match_Document SearchServer::MatchResolvedQuery(const ExecutionPolicy& execution_policy,
+                                                const ResolvedQuery& query,
+                                                int document_id) const {
+    const std::vector<int>& term_ids = documents_.at(document_id).term_ids;
+    const DocumentStatus status = GetDocumentStatus(document_id);
+    
+    const auto is_in_document = [&term_ids] (int term_id) {
+        return std::binary_search(term_ids.begin(), term_ids.end(), term_id);
+    };
+    
+    if (std::any_of(query.minus_term_ids.begin(), query.minus_term_ids.end(), is_in_document)
+        || query.has_unknown_required_word
+        || !std::all_of(query.required_term_ids.begin(), query.required_term_ids.end(), is_in_document)) {
+        return { std::vector<std::string_view>{}, status };
+    }
+    
+    std::vector<int> matched_term_ids;
+    if (std::is_same_v<ExecutionPolicy, std::execution::parallel_policy>
+        && query.plus_term_ids.size() >= MATCH_DOCUMENT_PARALLEL_THRESHOLD) {
+        matched_term_ids.resize(query.plus_term_ids.size());
+        const auto matched_end = std::copy_if(execution_policy,
+            query.plus_term_ids.begin(), query.plus_term_ids.end(),
+            matched_term_ids.begin(), is_in_document);
+        matched_term_ids.erase(matched_end, matched_term_ids.end());
+    }
+    else {
+        GallopingIntersect(query.plus_term_ids.begin(), query.plus_term_ids.end(),
+                           term_ids.begin(), term_ids.end(),
+                           std::back_inserter(matched_term_ids));
+    }
+    
+    std::vector<std::string_view> matched_words(matched_term_ids.size());
+    std::transform(matched_term_ids.begin(), matched_term_ids.end(), matched_words.begin(),
+                   [this] (int term_id) { return term_id_to_word_[term_id]; });
+    std::sort(matched_words.begin(), matched_words.end());
+    
+    return { matched_words, status };
+}
@@ -0,0 +1,221 @@
+#include "shard_coordinator.h"
+#include "shard_protocol.h"
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <execution>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Returns the reader positioned after an OK status, or nothing for a failed shard.
+// An invalid query is invalid on every shard, so it is reported to the caller
+std::optional<MessageReader> OpenResponse(const std::optional<std::string>& response) {
+    if (!response) {
+        return std::nullopt;
+    }
+    try {
+        MessageReader reader(*response);
+        const auto status = static_cast<ShardResponseStatus>(reader.ReadUint8());
+        if (status == ShardResponseStatus::OK) {
+            return reader;
+        }
+        if (status == ShardResponseStatus::INVALID_ARGUMENT) {
+            throw std::invalid_argument(std::string(reader.ReadString()));
+        }
+    }
+    catch (const std::out_of_range&) {
+    }
+    return std::nullopt;
+}
+
+}  // namespace
+
+
+ShardCoordinator::ShardCoordinator(const std::vector<std::string>& shard_addresses,
+                                   std::chrono::milliseconds shard_timeout)
+    : shard_timeout_(shard_timeout)
+{
+    if (shard_addresses.empty()) {
+        using namespace std::string_literals;
+        throw std::invalid_argument("Shard list is empty"s);
+    }
+    for (const std::string& address : shard_addresses) {
+        shards_.push_back({ address, {} });
+    }
+}
+
+ShardCoordinator::~ShardCoordinator() {
+    for (const ShardPool& shard : shards_) {
+        for (const int fd : shard.idle_fds) {
+            close(fd);
+        }
+    }
+}
+
+CoordinatedSearchResult ShardCoordinator::FindTopDocuments(const std::string_view& raw_query,
+                                                           DocumentStatus status) {
+    std::vector<std::string> requests(shards_.size());
+    for (std::string& request : requests) {
+        MessageWriter writer;
+        writer.WriteUint8(static_cast<uint8_t>(ShardRequestType::STATISTICS));
+        writer.WriteString(raw_query);
+        request = writer.Release();
+    }
+
+    QueryStatistics statistics;
+    std::vector<bool> has_statistics(shards_.size(), false);
+    const auto statistics_responses = Exchange(requests);
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        auto reader = OpenResponse(statistics_responses[i]);
+        if (!reader) {
+            continue;
+        }
+        try {
+            statistics.Merge(reader->ReadStatistics());
+            has_statistics[i] = true;
+        }
+        catch (const std::out_of_range&) {
+        }
+    }
+
+    // Shards that failed the first round are not asked again for this query
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        requests[i].clear();
+        if (!has_statistics[i]) {
+            continue;
+        }
+        MessageWriter writer;
+        writer.WriteUint8(static_cast<uint8_t>(ShardRequestType::FIND_TOP_DOCUMENTS));
+        writer.WriteString(raw_query);
+        writer.WriteUint8(static_cast<uint8_t>(status));
+        writer.WriteStatistics(statistics);
+        requests[i] = writer.Release();
+    }
+
+    CoordinatedSearchResult result;
+    const auto documents_responses = Exchange(requests);
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        auto reader = OpenResponse(documents_responses[i]);
+        if (!reader) {
+            ++result.unavailable_shard_count;
+            continue;
+        }
+        try {
+            std::vector<Document> documents(reader->ReadUint32());
+            for (Document& document : documents) {
+                document.id = reader->ReadInt32();
+                document.relevance = reader->ReadDouble();
+                document.rating = reader->ReadInt32();
+            }
+            result.documents.insert(result.documents.end(), documents.begin(), documents.end());
+        }
+        catch (const std::out_of_range&) {
+            ++result.unavailable_shard_count;
+        }
+    }
+    KeepTopDocuments(std::execution::seq, result.documents);
+    return result;
+}
+
+CoordinatedSearchResult ShardCoordinator::FindTopDocuments(const std::string_view& raw_query) {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+std::optional<Remote_Match_Document> ShardCoordinator::MatchDocument(const std::string_view& raw_query,
+                                                                     int document_id) {
+    const size_t shard_index = uint64_t(document_id) % shards_.size();
+    std::vector<std::string> requests(shards_.size());
+    MessageWriter writer;
+    writer.WriteUint8(static_cast<uint8_t>(ShardRequestType::MATCH_DOCUMENT));
+    writer.WriteString(raw_query);
+    writer.WriteInt32(document_id);
+    requests[shard_index] = writer.Release();
+
+    const auto responses = Exchange(requests);
+    const auto& response = responses[shard_index];
+    if (response && !response->empty()
+        && static_cast<ShardResponseStatus>((*response)[0]) == ShardResponseStatus::OUT_OF_RANGE) {
+        using namespace std::string_literals;
+        throw std::out_of_range("Unknown document_id "s + std::to_string(document_id));
+    }
+    auto reader = OpenResponse(response);
+    if (!reader) {
+        return std::nullopt;
+    }
+    try {
+        std::vector<std::string> words(reader->ReadUint32());
+        for (std::string& word : words) {
+            word = reader->ReadString();
+        }
+        const auto status = static_cast<DocumentStatus>(reader->ReadUint8());
+        return Remote_Match_Document{ std::move(words), status };
+    }
+    catch (const std::out_of_range&) {
+        return std::nullopt;
+    }
+}
+
+size_t ShardCoordinator::GetShardCount() const {
+    return shards_.size();
+}
+
+std::vector<std::optional<std::string>> ShardCoordinator::Exchange(const std::vector<std::string>& requests) {
+    std::vector<std::optional<std::string>> responses(shards_.size());
+    std::vector<int> fds(shards_.size(), -1);
+
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        if (requests[i].empty()) {
+            continue;
+        }
+        const int fd = AcquireConnection(i);
+        if (fd < 0) {
+            continue;
+        }
+        if (!SendMessage(fd, requests[i])) {
+            close(fd);
+            continue;
+        }
+        fds[i] = fd;
+    }
+
+    // Shards work concurrently, so waiting for them one by one against
+    // a shared deadline bounds the whole exchange by one timeout
+    const Deadline deadline = std::chrono::steady_clock::now() + shard_timeout_;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        if (fds[i] < 0) {
+            continue;
+        }
+        std::string payload;
+        if (ReceiveMessage(fds[i], payload, deadline)) {
+            responses[i] = std::move(payload);
+            ReleaseConnection(i, fds[i]);
+        }
+        else {
+            // A late answer would desynchronise the connection
+            close(fds[i]);
+        }
+    }
+    return responses;
+}
+
+int ShardCoordinator::AcquireConnection(size_t shard_index) {
+    {
+        std::lock_guard guard(pool_mutex_);
+        std::vector<int>& idle_fds = shards_[shard_index].idle_fds;
+        if (!idle_fds.empty()) {
+            const int fd = idle_fds.back();
+            idle_fds.pop_back();
+            return fd;
+        }
+    }
+    return ConnectShardSocket(shards_[shard_index].address);
+}
+
+void ShardCoordinator::ReleaseConnection(size_t shard_index, int fd) {
+    std::lock_guard guard(pool_mutex_);
+    shards_[shard_index].idle_fds.push_back(fd);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "document.h"
+#include "search_server.h"
+
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+struct CoordinatedSearchResult {
+    std::vector<Document> documents;
+    // Shards that were down, failed or missed the deadline; their documents are absent
+    size_t unavailable_shard_count = 0;
+};
+
+using Remote_Match_Document = std::tuple<std::vector<std::string>, DocumentStatus>;
+
+// Fans queries out to ShardServer processes and merges their answers.
+// Document frequencies are collected from every shard first, so IDF is the
+// same as on a single server. A shard that does not answer within the
+// timeout is skipped for the query and reconnected on the next one.
+// Documents must be distributed as in ShardedSearchServer: id % shard count.
+// Queries may be issued from several threads; every call takes its own
+// connections from a per-shard pool, so callers do not wait for each other
+class ShardCoordinator {
+public:
+    ShardCoordinator(const std::vector<std::string>& shard_addresses,
+                     std::chrono::milliseconds shard_timeout);
+    ~ShardCoordinator();
+
+    ShardCoordinator(const ShardCoordinator&) = delete;
+    ShardCoordinator& operator=(const ShardCoordinator&) = delete;
+
+    CoordinatedSearchResult FindTopDocuments(const std::string_view& raw_query,
+                                             DocumentStatus status);
+    CoordinatedSearchResult FindTopDocuments(const std::string_view& raw_query);
+
+    // Empty when the shard owning the document is unavailable
+    std::optional<Remote_Match_Document> MatchDocument(const std::string_view& raw_query,
+                                                       int document_id);
+
+    size_t GetShardCount() const;
+
+private:
+    struct ShardPool {
+        std::string address;
+        std::vector<int> idle_fds;
+    };
+    std::vector<ShardPool> shards_;
+    const std::chrono::milliseconds shard_timeout_;
+    // Guards only the idle lists, never held during network exchange
+    std::mutex pool_mutex_;
+
+    // Sends requests[i] to shards_[i] for every non-empty request and waits for
+    // the answers until the common deadline; missing answers are left empty
+    std::vector<std::optional<std::string>> Exchange(const std::vector<std::string>& requests);
+
+    // Returns an idle connection to the shard or opens a new one, -1 when the shard is down
+    int AcquireConnection(size_t shard_index);
+    void ReleaseConnection(size_t shard_index, int fd);
+};
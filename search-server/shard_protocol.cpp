@@ -0,0 +1,274 @@
+#include "shard_protocol.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+MessageWriter::MessageWriter()
+    : buffer_(sizeof(uint32_t), '\0')  // Place for the payload size
+{}
+
+template <typename Value>
+void MessageWriter::WriteValue(Value value) {
+    buffer_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void MessageWriter::WriteUint8(uint8_t value) {
+    WriteValue(value);
+}
+
+void MessageWriter::WriteInt32(int32_t value) {
+    WriteValue(value);
+}
+
+void MessageWriter::WriteUint32(uint32_t value) {
+    WriteValue(value);
+}
+
+void MessageWriter::WriteDouble(double value) {
+    WriteValue(value);
+}
+
+void MessageWriter::WriteString(std::string_view value) {
+    WriteUint32(static_cast<uint32_t>(value.size()));
+    buffer_.append(value.data(), value.size());
+}
+
+void MessageWriter::WriteStatistics(const QueryStatistics& statistics) {
+    WriteInt32(statistics.document_count);
+    WriteUint32(static_cast<uint32_t>(statistics.document_freqs.size()));
+    for (const auto& [word, document_freq] : statistics.document_freqs) {
+        WriteString(word);
+        WriteInt32(document_freq);
+    }
+}
+
+std::string MessageWriter::Release() {
+    const uint32_t payload_size = static_cast<uint32_t>(buffer_.size() - sizeof(uint32_t));
+    std::memcpy(buffer_.data(), &payload_size, sizeof(payload_size));
+    return std::move(buffer_);
+}
+
+
+MessageReader::MessageReader(std::string_view payload)
+    : payload_(payload)
+{}
+
+template <typename Value>
+Value MessageReader::ReadValue() {
+    if (payload_.size() < sizeof(Value)) {
+        using namespace std::string_literals;
+        throw std::out_of_range("Truncated shard message"s);
+    }
+    Value value;
+    std::memcpy(&value, payload_.data(), sizeof(value));
+    payload_.remove_prefix(sizeof(value));
+    return value;
+}
+
+uint8_t MessageReader::ReadUint8() {
+    return ReadValue<uint8_t>();
+}
+
+int32_t MessageReader::ReadInt32() {
+    return ReadValue<int32_t>();
+}
+
+uint32_t MessageReader::ReadUint32() {
+    return ReadValue<uint32_t>();
+}
+
+double MessageReader::ReadDouble() {
+    return ReadValue<double>();
+}
+
+std::string_view MessageReader::ReadString() {
+    const uint32_t size = ReadUint32();
+    if (payload_.size() < size) {
+        using namespace std::string_literals;
+        throw std::out_of_range("Truncated shard message"s);
+    }
+    const std::string_view value = payload_.substr(0, size);
+    payload_.remove_prefix(size);
+    return value;
+}
+
+QueryStatistics MessageReader::ReadStatistics() {
+    QueryStatistics statistics;
+    statistics.document_count = ReadInt32();
+    const uint32_t word_count = ReadUint32();
+    for (uint32_t i = 0; i < word_count; ++i) {
+        const std::string_view word = ReadString();
+        statistics.document_freqs.emplace(word, ReadInt32());
+    }
+    return statistics;
+}
+
+
+namespace {
+
+struct SocketAddress {
+    sockaddr_storage storage = {};
+    socklen_t size = 0;
+    std::string unix_path;
+};
+
+SocketAddress ParseShardAddress(const std::string& address) {
+    using namespace std::string_literals;
+    SocketAddress result;
+    if (address.rfind("unix:"s, 0) == 0) {
+        result.unix_path = address.substr(5);
+        sockaddr_un* unix_address = reinterpret_cast<sockaddr_un*>(&result.storage);
+        if (result.unix_path.empty() || result.unix_path.size() >= sizeof(unix_address->sun_path)) {
+            throw std::invalid_argument("Invalid unix socket path in "s + address);
+        }
+        unix_address->sun_family = AF_UNIX;
+        std::memcpy(unix_address->sun_path, result.unix_path.data(), result.unix_path.size());
+        result.size = sizeof(sockaddr_un);
+        return result;
+    }
+    if (address.rfind("tcp:"s, 0) == 0) {
+        const size_t port_separator = address.rfind(':');
+        const std::string host = address.substr(4, port_separator - 4);
+        const int port = std::atoi(address.c_str() + port_separator + 1);
+        sockaddr_in* ip_address = reinterpret_cast<sockaddr_in*>(&result.storage);
+        ip_address->sin_family = AF_INET;
+        ip_address->sin_port = htons(static_cast<uint16_t>(port));
+        // Port 0 lets the system pick a free port when listening
+        if (port < 0 || port > 65535 || inet_pton(AF_INET, host.c_str(), &ip_address->sin_addr) != 1) {
+            throw std::invalid_argument("Invalid tcp address "s + address);
+        }
+        result.size = sizeof(sockaddr_in);
+        return result;
+    }
+    throw std::invalid_argument("Unknown shard address scheme in "s + address);
+}
+
+[[noreturn]] void ThrowSocketError(const std::string& what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+int WaitForSocket(int fd, short events, Deadline deadline) {
+    int timeout_ms = -1;
+    if (deadline != Deadline::max()) {
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        timeout_ms = static_cast<int>(std::max<decltype(remaining)>(remaining, 0));
+    }
+    pollfd poll_fd = { fd, events, 0 };
+    int ready = 0;
+    do {
+        ready = poll(&poll_fd, 1, timeout_ms);
+    } while (ready < 0 && errno == EINTR);
+    return ready;
+}
+
+bool ReceiveExactly(int fd, char* data, size_t size, Deadline deadline) {
+    while (size > 0) {
+        if (WaitForSocket(fd, POLLIN, deadline) <= 0) {
+            return false;
+        }
+        const ssize_t received = recv(fd, data, size, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+}  // namespace
+
+
+int ListenShardSocket(const std::string& address) {
+    const SocketAddress socket_address = ParseShardAddress(address);
+    const int fd = socket(socket_address.storage.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        ThrowSocketError("socket");
+    }
+    if (!socket_address.unix_path.empty()) {
+        unlink(socket_address.unix_path.c_str());
+    }
+    else {
+        const int enable = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    }
+    if (bind(fd, reinterpret_cast<const sockaddr*>(&socket_address.storage), socket_address.size) < 0
+        || listen(fd, SOMAXCONN) < 0) {
+        const int error = errno;
+        close(fd);
+        errno = error;
+        ThrowSocketError("listen on " + address);
+    }
+    return fd;
+}
+
+std::string GetShardSocketAddress(int fd) {
+    using namespace std::string_literals;
+    sockaddr_storage storage = {};
+    socklen_t size = sizeof(storage);
+    if (getsockname(fd, reinterpret_cast<sockaddr*>(&storage), &size) < 0) {
+        ThrowSocketError("getsockname");
+    }
+    if (storage.ss_family == AF_UNIX) {
+        const sockaddr_un* unix_address = reinterpret_cast<const sockaddr_un*>(&storage);
+        return "unix:"s + std::string(unix_address->sun_path, strnlen(unix_address->sun_path, sizeof(unix_address->sun_path)));
+    }
+    const sockaddr_in* ip_address = reinterpret_cast<const sockaddr_in*>(&storage);
+    char host[INET_ADDRSTRLEN] = {};
+    inet_ntop(AF_INET, &ip_address->sin_addr, host, sizeof(host));
+    return "tcp:"s + host + ":"s + std::to_string(ntohs(ip_address->sin_port));
+}
+
+int ConnectShardSocket(const std::string& address) {
+    const SocketAddress socket_address = ParseShardAddress(address);
+    const int fd = socket(socket_address.storage.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&socket_address.storage), socket_address.size) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool SendMessage(int fd, const std::string& message) {
+    size_t sent_total = 0;
+    while (sent_total < message.size()) {
+        const ssize_t sent = send(fd, message.data() + sent_total, message.size() - sent_total, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        sent_total += static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool ReceiveMessage(int fd, std::string& payload, Deadline deadline) {
+    uint32_t payload_size = 0;
+    if (!ReceiveExactly(fd, reinterpret_cast<char*>(&payload_size), sizeof(payload_size), deadline)
+        || payload_size > MAX_SHARD_MESSAGE_SIZE) {
+        return false;
+    }
+    payload.resize(payload_size);
+    return ReceiveExactly(fd, payload.data(), payload_size, deadline);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "document.h"
+#include "search_server.h"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Binary protocol between a ShardCoordinator and ShardServer processes.
+// Every message is a uint32 payload size followed by the payload; a request
+// payload starts with ShardRequestType, a response with ShardResponseStatus.
+// Both ends run on one host, so numbers travel in native byte order
+
+enum class ShardRequestType : uint8_t {
+    STATISTICS = 1,          // query -> QueryStatistics
+    FIND_TOP_DOCUMENTS = 2,  // query, status, QueryStatistics -> documents
+    MATCH_DOCUMENT = 3,      // query, document id -> words, status
+};
+
+enum class ShardResponseStatus : uint8_t {
+    OK = 0,
+    INVALID_ARGUMENT = 1,
+    OUT_OF_RANGE = 2,
+    INTERNAL_ERROR = 3,
+};
+
+const uint32_t MAX_SHARD_MESSAGE_SIZE = 64u << 20;
+
+class MessageWriter {
+public:
+    MessageWriter();
+
+    void WriteUint8(uint8_t value);
+    void WriteInt32(int32_t value);
+    void WriteUint32(uint32_t value);
+    void WriteDouble(double value);
+    void WriteString(std::string_view value);
+    void WriteStatistics(const QueryStatistics& statistics);
+
+    // Returns the framed message ready to be sent
+    std::string Release();
+
+private:
+    std::string buffer_;
+
+    template <typename Value>
+    void WriteValue(Value value);
+};
+
+// Reads a payload received without its size prefix, throws std::out_of_range
+// when the payload is shorter than expected
+class MessageReader {
+public:
+    explicit MessageReader(std::string_view payload);
+
+    uint8_t ReadUint8();
+    int32_t ReadInt32();
+    uint32_t ReadUint32();
+    double ReadDouble();
+    std::string_view ReadString();
+    QueryStatistics ReadStatistics();
+
+private:
+    std::string_view payload_;
+
+    template <typename Value>
+    Value ReadValue();
+};
+
+// Addresses are "unix:<socket path>" or "tcp:<ipv4 address>:<port>",
+// a listening tcp socket may ask for port 0 to get any free port
+int ListenShardSocket(const std::string& address);
+int ConnectShardSocket(const std::string& address);
+// Address a socket is bound to, with the port actually chosen
+std::string GetShardSocketAddress(int fd);
+
+bool SendMessage(int fd, const std::string& message);
+// Receives one payload, fails on a closed socket, a malformed size or the deadline
+bool ReceiveMessage(int fd, std::string& payload, Deadline deadline = Deadline::max());
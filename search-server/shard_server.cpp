@@ -0,0 +1,153 @@
+#include "shard_server.h"
+#include "shard_protocol.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <execution>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+ShardServer::ShardServer(const SearchServer& search_server, const std::string& address)
+    : search_server_(search_server)
+    , listen_fd_(ListenShardSocket(address))
+{}
+
+ShardServer::~ShardServer() {
+    Stop();
+    close(listen_fd_);
+}
+
+void ShardServer::Run() {
+    while (!stopped_) {
+        const int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+        JoinFinishedThreads();
+        std::lock_guard guard(connections_mutex_);
+        if (stopped_) {
+            close(fd);
+            break;
+        }
+        connection_fds_.insert(fd);
+        const uint64_t connection_id = next_connection_id_++;
+        connection_threads_.emplace(connection_id,
+                                    std::thread(&ShardServer::ServeConnection, this, connection_id, fd));
+    }
+    {
+        std::unique_lock lock(connections_mutex_);
+        connection_finished_.wait(lock, [this] { return connection_threads_.empty(); });
+    }
+    JoinFinishedThreads();
+}
+
+void ShardServer::Stop() {
+    stopped_ = true;
+    // Shutdown wakes the threads blocked in accept and recv
+    shutdown(listen_fd_, SHUT_RDWR);
+    std::lock_guard guard(connections_mutex_);
+    for (const int fd : connection_fds_) {
+        shutdown(fd, SHUT_RDWR);
+    }
+}
+
+std::string ShardServer::GetAddress() const {
+    return GetShardSocketAddress(listen_fd_);
+}
+
+void ShardServer::ServeConnection(uint64_t connection_id, int fd) {
+    std::string payload;
+    while (!stopped_ && ReceiveMessage(fd, payload)) {
+        if (!SendMessage(fd, HandleRequest(payload))) {
+            break;
+        }
+    }
+    std::lock_guard guard(connections_mutex_);
+    connection_fds_.erase(fd);
+    close(fd);
+    // The thread is inserted under the same lock before it can get here
+    auto node = connection_threads_.extract(connection_id);
+    finished_threads_.push_back(std::move(node.mapped()));
+    connection_finished_.notify_all();
+}
+
+void ShardServer::JoinFinishedThreads() {
+    std::vector<std::thread> finished_threads;
+    {
+        std::lock_guard guard(connections_mutex_);
+        finished_threads.swap(finished_threads_);
+    }
+    for (std::thread& thread : finished_threads) {
+        thread.join();
+    }
+}
+
+std::string ShardServer::HandleRequest(std::string_view payload) const {
+    const auto make_error = [] (ShardResponseStatus status, std::string_view what) {
+        MessageWriter writer;
+        writer.WriteUint8(static_cast<uint8_t>(status));
+        writer.WriteString(what);
+        return writer.Release();
+    };
+
+    try {
+        MessageReader reader(payload);
+        const auto request_type = static_cast<ShardRequestType>(reader.ReadUint8());
+        const std::string_view raw_query = reader.ReadString();
+
+        MessageWriter writer;
+        switch (request_type) {
+        case ShardRequestType::STATISTICS: {
+            const QueryStatistics statistics = search_server_.GetQueryStatistics(raw_query);
+            writer.WriteUint8(static_cast<uint8_t>(ShardResponseStatus::OK));
+            writer.WriteStatistics(statistics);
+            break;
+        }
+        case ShardRequestType::FIND_TOP_DOCUMENTS: {
+            const auto status = static_cast<DocumentStatus>(reader.ReadUint8());
+            const QueryStatistics statistics = reader.ReadStatistics();
+            const auto documents = search_server_.FindTopDocuments(std::execution::seq, raw_query,
+                                                                   status, statistics);
+            writer.WriteUint8(static_cast<uint8_t>(ShardResponseStatus::OK));
+            writer.WriteUint32(static_cast<uint32_t>(documents.size()));
+            for (const Document& document : documents) {
+                writer.WriteInt32(document.id);
+                writer.WriteDouble(document.relevance);
+                writer.WriteInt32(document.rating);
+            }
+            break;
+        }
+        case ShardRequestType::MATCH_DOCUMENT: {
+            const int document_id = reader.ReadInt32();
+            const auto [words, status] = search_server_.MatchDocument(raw_query, document_id);
+            writer.WriteUint8(static_cast<uint8_t>(ShardResponseStatus::OK));
+            writer.WriteUint32(static_cast<uint32_t>(words.size()));
+            for (const std::string_view word : words) {
+                writer.WriteString(word);
+            }
+            writer.WriteUint8(static_cast<uint8_t>(status));
+            break;
+        }
+        default: {
+            using namespace std::string_literals;
+            return make_error(ShardResponseStatus::INVALID_ARGUMENT, "Unknown shard request"s);
+        }
+        }
+        return writer.Release();
+    }
+    catch (const std::invalid_argument& e) {
+        return make_error(ShardResponseStatus::INVALID_ARGUMENT, e.what());
+    }
+    catch (const std::out_of_range& e) {
+        return make_error(ShardResponseStatus::OUT_OF_RANGE, e.what());
+    }
+    catch (const std::exception& e) {
+        return make_error(ShardResponseStatus::INTERNAL_ERROR, e.what());
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Serves one SearchServer to ShardCoordinator clients over a unix or tcp
+// socket, one thread per connection. The server must not be modified
+// while Run() is active, and Run() must return before destruction
+class ShardServer {
+public:
+    ShardServer(const SearchServer& search_server, const std::string& address);
+    ~ShardServer();
+
+    ShardServer(const ShardServer&) = delete;
+    ShardServer& operator=(const ShardServer&) = delete;
+
+    // Blocks until Stop() is called
+    void Run();
+    void Stop();
+
+    // Bound address, tells the port picked for "tcp:<ipv4 address>:0".
+    // Clients may connect as soon as the server is constructed
+    std::string GetAddress() const;
+
+private:
+    const SearchServer& search_server_;
+    const int listen_fd_;
+    std::atomic<bool> stopped_ = false;
+
+    std::mutex connections_mutex_;
+    std::condition_variable connection_finished_;
+    std::set<int> connection_fds_;
+    // A connection thread moves itself to finished_threads_ when it is done,
+    // the accept loop joins those before taking the next connection
+    uint64_t next_connection_id_ = 0;
+    std::unordered_map<uint64_t, std::thread> connection_threads_;
+    std::vector<std::thread> finished_threads_;
+
+    void ServeConnection(uint64_t connection_id, int fd);
+    void JoinFinishedThreads();
+    std::string HandleRequest(std::string_view payload) const;
+};
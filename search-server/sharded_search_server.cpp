@@ -0,0 +1,100 @@
+#include "sharded_search_server.h"
+
+#include <cstdint>
+#include <execution>
+#include <mutex>
+#include <numeric>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+ShardedSearchServer::ShardedSearchServer(size_t shard_count, const std::string& stop_words_text)
+    : ShardedSearchServer(shard_count,
+        SplitIntoWords(stop_words_text))  // Invoke delegating constructor from string container
+{}
+
+
+void ShardedSearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status,
+    const std::vector<int>& ratings) {
+    if (document_id < 0) {
+        using namespace std::string_literals;
+        throw std::invalid_argument("Invalid document_id"s);
+    }
+    Shard& shard = GetShard(document_id);
+    std::unique_lock lock(shard.mutex);
+    shard.server.AddDocument(document_id, document, status, ratings);
+}
+
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    Shard& shard = GetShard(document_id);
+    std::unique_lock lock(shard.mutex);
+    shard.server.RemoveDocument(document_id);
+}
+
+
+void ShardedSearchServer::UpdateDocument(int document_id, const std::string_view document, DocumentStatus status,
+    const std::vector<int>& ratings) {
+    Shard& shard = GetShard(document_id);
+    std::unique_lock lock(shard.mutex);
+    shard.server.UpdateDocument(document_id, document, status, ratings);
+}
+
+
+void ShardedSearchServer::SetDocumentStatus(int document_id, DocumentStatus status) {
+    Shard& shard = GetShard(document_id);
+    std::unique_lock lock(shard.mutex);
+    shard.server.SetDocumentStatus(document_id, status);
+}
+
+
+void ShardedSearchServer::SetDocumentRating(int document_id, int rating) {
+    Shard& shard = GetShard(document_id);
+    std::unique_lock lock(shard.mutex);
+    shard.server.SetDocumentRating(document_id, rating);
+}
+
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view& raw_query,
+                                                            DocumentStatus status) const {
+    // Only the postings of the status are walked, as in SearchServer::FindTopDocuments
+    return FindTopDocumentsInShards(raw_query,
+        [&] (const SearchServer& server, const QueryStatistics& statistics) {
+            return server.FindTopDocuments(std::execution::seq, raw_query, status, statistics);
+        });
+}
+
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view& raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+
+Match_Document ShardedSearchServer::MatchDocument(const std::string_view& raw_query, int document_id) const {
+    const Shard& shard = GetShard(document_id);
+    std::shared_lock lock(shard.mutex);
+    return shard.server.MatchDocument(raw_query, document_id);
+}
+
+
+int ShardedSearchServer::GetDocumentCount() const {
+    return std::accumulate(shards_.begin(), shards_.end(), 0, [] (int count, const Shard& shard) {
+        std::shared_lock lock(shard.mutex);
+        return count + shard.server.GetDocumentCount();
+    });
+}
+
+
+size_t ShardedSearchServer::GetShardCount() const {
+    return shards_.size();
+}
+
+
+ShardedSearchServer::Shard& ShardedSearchServer::GetShard(int document_id) {
+    return shards_[uint64_t(document_id) % shards_.size()];
+}
+
+
+const ShardedSearchServer::Shard& ShardedSearchServer::GetShard(int document_id) const {
+    return shards_[uint64_t(document_id) % shards_.size()];
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "search_server.h"
+#include "document.h"
+
+#include <algorithm>
+#include <deque>
+#include <execution>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Documents are partitioned across independent SearchServer shards by id.
+// Writers lock only their shard, queries fan out to all shards in parallel
+// and score with corpus-wide document frequencies, so results match a single
+// SearchServer holding every document
+class ShardedSearchServer {
+public:
+    template <typename StringContainer>
+    ShardedSearchServer(size_t shard_count, const StringContainer& stop_words);
+    ShardedSearchServer(size_t shard_count, const std::string& stop_words_text);
+
+    void AddDocument(int document_id, const std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings);
+
+    void RemoveDocument(int document_id);
+
+    void UpdateDocument(int document_id, const std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings);
+    void SetDocumentStatus(int document_id, DocumentStatus status);
+    void SetDocumentRating(int document_id, int rating);
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query,
+                                           DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query,
+                                           DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query) const;
+
+    Match_Document MatchDocument(const std::string_view& raw_query, int document_id) const;
+
+    int GetDocumentCount() const;
+    size_t GetShardCount() const;
+
+private:
+    struct Shard {
+        template <typename StringContainer>
+        explicit Shard(const StringContainer& stop_words) : server(stop_words) {}
+
+        mutable std::shared_mutex mutex;
+        SearchServer server;
+    };
+    std::deque<Shard> shards_;
+
+    Shard& GetShard(int document_id);
+    const Shard& GetShard(int document_id) const;
+
+    // Runs search_shard(server, statistics) on every shard with the merged
+    // statistics of the query and keeps the top of all their results
+    template <typename ShardSearch>
+    std::vector<Document> FindTopDocumentsInShards(const std::string_view& raw_query,
+                                                   ShardSearch search_shard) const;
+};
+
+
+template <typename StringContainer>
+ShardedSearchServer::ShardedSearchServer(size_t shard_count, const StringContainer& stop_words) {
+    if (shard_count == 0) {
+        using namespace std::string_literals;
+        throw std::invalid_argument("Shard count must be positive"s);
+    }
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.emplace_back(stop_words);
+    }
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view& raw_query,
+                                                            DocumentPredicate document_predicate) const {
+    return FindTopDocumentsInShards(raw_query,
+        [&] (const SearchServer& server, const QueryStatistics& statistics) {
+            return server.FindTopDocuments(std::execution::seq, raw_query, document_predicate, statistics);
+        });
+}
+
+template <typename ShardSearch>
+std::vector<Document> ShardedSearchServer::FindTopDocumentsInShards(const std::string_view& raw_query,
+                                                                    ShardSearch search_shard) const {
+    // Shared locks on every shard keep statistics and postings consistent
+    std::vector<std::shared_lock<std::shared_mutex>> locks;
+    locks.reserve(shards_.size());
+    for (const Shard& shard : shards_) {
+        locks.emplace_back(shard.mutex);
+    }
+
+    std::vector<QueryStatistics> shard_statistics(shards_.size());
+    std::transform(std::execution::par,
+                   shards_.begin(), shards_.end(),
+                   shard_statistics.begin(),
+                   [&raw_query] (const Shard& shard) {
+                       return shard.server.GetQueryStatistics(raw_query);
+                   });
+    QueryStatistics statistics;
+    for (const QueryStatistics& part : shard_statistics) {
+        statistics.Merge(part);
+    }
+
+    std::vector<std::vector<Document>> shard_documents(shards_.size());
+    std::transform(std::execution::par,
+                   shards_.begin(), shards_.end(),
+                   shard_documents.begin(),
+                   [&] (const Shard& shard) {
+                       return search_shard(shard.server, statistics);
+                   });
+
+    std::vector<Document> result;
+    for (const std::vector<Document>& documents : shard_documents) {
+        result.insert(result.end(), documents.begin(), documents.end());
+    }
+    KeepTopDocuments(std::execution::seq, result);
+    return result;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+
+// Finds the first element not less than value: the step doubles from the range start,
+// then binary search runs inside the found window. Cheap when the target is near
+template <typename Iterator, typename Value>
+Iterator GallopLowerBound(Iterator first, Iterator last, const Value& value) {
+    typename std::iterator_traits<Iterator>::difference_type step = 1;
+    Iterator window_begin = first;
+    while (window_begin != last && *window_begin < value) {
+        const auto remaining = std::distance(window_begin, last);
+        if (step >= remaining) {
+            return std::lower_bound(window_begin, last, value);
+        }
+        Iterator probe = std::next(window_begin, step);
+        if (!(*probe < value)) {
+            return std::lower_bound(window_begin, probe, value);
+        }
+        window_begin = probe;
+        step *= 2;
+    }
+    return window_begin;
+}
+
+// Intersects two sorted ranges without duplicates.
+// The short range is walked, the position in the long one is found by galloping
+template <typename SmallIterator, typename LargeIterator, typename OutputIterator>
+OutputIterator GallopingIntersect(SmallIterator small_first, SmallIterator small_last,
+                                  LargeIterator large_first, LargeIterator large_last,
+                                  OutputIterator output) {
+    for (; small_first != small_last && large_first != large_last; ++small_first) {
+        large_first = GallopLowerBound(large_first, large_last, *small_first);
+        if (large_first != large_last && !(*small_first < *large_first)) {
+            *output++ = *small_first;
+            ++large_first;
+        }
+    }
+    return output;
+}
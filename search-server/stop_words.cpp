@@ -0,0 +1,91 @@
+#include "stop_words.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+StopWordSet::StopWordSet(const std::set<std::string, std::less<>>& words) {
+    if (words.empty()) {
+        return;
+    }
+    const size_t word_count = words.size();
+    const size_t bucket_count = word_count / 4 + 1;
+
+    std::vector<std::vector<const std::string*>> buckets(bucket_count);
+    for (const std::string& word : words) {
+        buckets[HashStopWord(word, 0) % bucket_count].push_back(&word);
+    }
+
+    std::vector<size_t> bucket_order(bucket_count);
+    for (size_t i = 0; i < bucket_count; ++i) {
+        bucket_order[i] = i;
+    }
+    std::sort(bucket_order.begin(), bucket_order.end(), [&buckets] (size_t lhs, size_t rhs) {
+        return buckets[lhs].size() > buckets[rhs].size();
+    });
+
+    const uint32_t MAX_SEED = 1u << 24;
+    std::vector<const std::string*> slot_words(word_count, nullptr);
+    std::vector<size_t> bucket_slots;
+    seeds_.assign(bucket_count, 0);
+
+    // Largest buckets go first while the table is still empty
+    for (const size_t bucket : bucket_order) {
+        if (buckets[bucket].empty()) {
+            break;
+        }
+        uint32_t seed = 1;
+        for (; seed < MAX_SEED; ++seed) {
+            bucket_slots.clear();
+            const bool placed = std::all_of(buckets[bucket].begin(), buckets[bucket].end(),
+                [&] (const std::string* word) {
+                    const size_t slot = HashStopWord(*word, seed) % word_count;
+                    if (slot_words[slot] != nullptr
+                        || std::count(bucket_slots.begin(), bucket_slots.end(), slot) > 0) {
+                        return false;
+                    }
+                    bucket_slots.push_back(slot);
+                    return true;
+                });
+            if (placed) {
+                break;
+            }
+        }
+        if (seed == MAX_SEED) {
+            using namespace std::string_literals;
+            throw std::logic_error("Failed to build perfect hash of stop words"s);
+        }
+        seeds_[bucket] = seed;
+        for (size_t i = 0; i < bucket_slots.size(); ++i) {
+            slot_words[bucket_slots[i]] = buckets[bucket][i];
+        }
+    }
+
+    words_.reserve(word_count);
+    fingerprints_.reserve(word_count);
+    for (const std::string* word : slot_words) {
+        words_.push_back(*word);
+        fingerprints_.push_back(static_cast<uint32_t>(HashStopWord(*word, 0) >> 32));
+        fingerprint_ += HashStopWord(*word, 0);
+    }
+
+    // Every word must land in its own slot and be found again
+    if (!std::all_of(words.begin(), words.end(), [this] (const std::string& word) { return count(word); })) {
+        using namespace std::string_literals;
+        throw std::logic_error("Perfect hash of stop words is inconsistent"s);
+    }
+}
+
+size_t StopWordSet::GetMemoryUsage() const {
+    static const size_t INLINE_CAPACITY = std::string().capacity();
+    size_t bytes = words_.capacity() * sizeof(std::string)
+        + fingerprints_.capacity() * sizeof(uint32_t)
+        + seeds_.capacity() * sizeof(uint32_t);
+    for (const std::string& word : words_) {
+        if (word.capacity() > INLINE_CAPACITY) {
+            bytes += word.capacity() + 1;
+        }
+    }
+    return bytes;
+}
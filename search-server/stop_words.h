@@ -0,0 +1,140 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Seeded FNV-1a with a splitmix finalizer, usable in constant expressions
+constexpr uint64_t HashStopWord(std::string_view word, uint64_t seed) {
+    uint64_t hash = 14695981039346656037ull ^ (seed * 0x9E3779B97F4A7C15ull);
+    for (const char c : word) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EBull;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+// Stop words stored in a minimal perfect hash (hash and displace):
+// a word is checked with two hashes, a fingerprint compare and, on a
+// fingerprint hit, a single string compare
+class StopWordSet {
+public:
+    StopWordSet() = default;
+    explicit StopWordSet(const std::set<std::string, std::less<>>& words);
+
+    bool count(std::string_view word) const {
+        if (words_.empty()) {
+            return false;
+        }
+        const uint64_t hash = HashStopWord(word, 0);
+        const uint32_t seed = seeds_[hash % seeds_.size()];
+        const size_t slot = HashStopWord(word, seed) % words_.size();
+        return fingerprints_[slot] == static_cast<uint32_t>(hash >> 32)
+            && words_[slot] == word;
+    }
+
+    std::vector<std::string>::const_iterator begin() const {
+        return words_.begin();
+    }
+    std::vector<std::string>::const_iterator end() const {
+        return words_.end();
+    }
+    size_t size() const {
+        return words_.size();
+    }
+    // Sum of the word hashes, equal for sets holding the same words
+    uint64_t GetFingerprint() const {
+        return fingerprint_;
+    }
+
+    // Estimated heap bytes of the table
+    size_t GetMemoryUsage() const;
+
+private:
+    std::vector<std::string> words_;        // indexed by slot
+    std::vector<uint32_t> fingerprints_;    // high half of the bucket hash, by slot
+    std::vector<uint32_t> seeds_;           // displacement seed, by bucket
+    uint64_t fingerprint_ = 0;
+};
+
+// Stop words known at compile time: an open addressing table built by the
+// constexpr constructor, so the size is a constant and lookups can be inlined
+// into the tokenizer. Slots keep the high hash half as a fingerprint, a probe
+// compares strings only on a fingerprint hit. Iterable, so it can also seed a SearchServer
+template <size_t N>
+class StaticStopWordSet {
+public:
+    constexpr explicit StaticStopWordSet(const std::array<std::string_view, N>& words)
+        : words_(words)
+    {
+        for (const std::string_view word : words_) {
+            // Empty words are never tokens, and repeated ones are stored once
+            if (word.empty() || count(word)) {
+                continue;
+            }
+            const uint64_t hash = HashStopWord(word, 0);
+            size_t slot = hash & (TABLE_SIZE - 1);
+            while (!table_[slot].word.empty()) {
+                slot = (slot + 1) & (TABLE_SIZE - 1);
+            }
+            table_[slot] = { word, static_cast<uint32_t>(hash >> 32) };
+            fingerprint_ += hash;
+        }
+    }
+
+    constexpr bool count(std::string_view word) const {
+        const uint64_t hash = HashStopWord(word, 0);
+        const uint32_t fingerprint = static_cast<uint32_t>(hash >> 32);
+        for (size_t slot = hash & (TABLE_SIZE - 1); !table_[slot].word.empty();
+             slot = (slot + 1) & (TABLE_SIZE - 1)) {
+            if (table_[slot].fingerprint == fingerprint && table_[slot].word == word) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    constexpr auto begin() const {
+        return words_.begin();
+    }
+    constexpr auto end() const {
+        return words_.end();
+    }
+    // Same as StopWordSet::GetFingerprint of a set built from these words
+    constexpr uint64_t GetFingerprint() const {
+        return fingerprint_;
+    }
+
+private:
+    struct Slot {
+        std::string_view word;  // empty marks a free slot
+        uint32_t fingerprint = 0;
+    };
+
+    // A power of two at least four times the word count keeps probe runs short
+    static constexpr size_t ComputeTableSize() {
+        size_t size = 1;
+        while (size < 4 * N) {
+            size *= 2;
+        }
+        return size;
+    }
+    static constexpr size_t TABLE_SIZE = ComputeTableSize();
+
+    std::array<std::string_view, N> words_;
+    std::array<Slot, TABLE_SIZE> table_{};
+    uint64_t fingerprint_ = 0;
+};
+
+template <typename... Words>
+constexpr auto MakeStaticStopWordSet(Words... words) {
+    return StaticStopWordSet<sizeof...(Words)>({ std::string_view(words)... });
+}
@@ -0,0 +1,1025 @@
+#include "test_example_functions.h"
+#include "corpus_loader.h"
+#include "document_slot_map.h"
+#include "remove_duplicates.h"
+#include "search_server.h"
+#include "shard_coordinator.h"
+#include "shard_server.h"
+#include "sharded_search_server.h"
+#include "string_processing.h"
+
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+void AssertImpl(bool value, const std::string& expr_str, const std::string& file, const std::string& func,
+                unsigned line, const std::string& hint) {
+    if (!value) {
+        std::cerr << file << "("s << line << "): "s << func << ": "s;
+        std::cerr << "ASSERT("s << expr_str << ") failed."s;
+        if (!hint.empty()) {
+            std::cerr << " Hint: "s << hint;
+        }
+        std::cerr << std::endl;
+        std::abort();
+    }
+}
+
+namespace {
+
+struct TestDocument {
+    int id = 0;
+    std::string text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
+
+// Random corpus over the words w0, w1, ... A small vocabulary makes queries hit many documents
+struct CorpusShape {
+    int document_count = 1000;
+    int vocabulary_size = 30;
+    // Words per document are drawn from [min_words, max_words]
+    int min_words = 8;
+    int max_words = 8;
+    // Zero draws words uniformly, otherwise the share of word k falls as
+    // exp(-word_decay * k), so the first words get long posting lists
+    double word_decay = 0.0;
+    // Statuses are drawn from the first status_count ones
+    int status_count = 2;
+    // Ratings are drawn from [min_rating, min_rating + rating_count)
+    int min_rating = -10;
+    int rating_count = 50;
+    // Document i gets id i * id_step, or 2e9 - i from gap_from on, leaving a wide gap
+    int id_step = 1;
+    int gap_from = std::numeric_limits<int>::max();
+};
+
+std::string MakeRandomText(std::mt19937& generator, const CorpusShape& shape) {
+    const int word_count = shape.min_words == shape.max_words
+        ? shape.min_words : shape.min_words + static_cast<int>(generator() % (shape.max_words - shape.min_words + 1));
+    std::string text;
+    for (int i = 0; i < word_count; ++i) {
+        const int word = shape.word_decay == 0.0
+            ? static_cast<int>(generator() % shape.vocabulary_size)
+            : std::min(shape.vocabulary_size - 1,
+                       static_cast<int>(std::exponential_distribution<>(shape.word_decay)(generator)));
+        text += "w"s + std::to_string(word) + " "s;
+    }
+    return text;
+}
+
+std::vector<TestDocument> MakeRandomDocuments(std::mt19937& generator, const CorpusShape& shape) {
+    std::vector<TestDocument> documents;
+    for (int i = 0; i < shape.document_count; ++i) {
+        TestDocument document;
+        document.id = i < shape.gap_from ? i * shape.id_step : 2000000000 - i;
+        document.text = MakeRandomText(generator, shape);
+        document.status = static_cast<DocumentStatus>(generator() % shape.status_count);
+        document.ratings = { shape.min_rating + static_cast<int>(generator() % shape.rating_count) };
+        documents.push_back(std::move(document));
+    }
+    return documents;
+}
+
+std::vector<TestDocument> MakeRandomDocuments(std::mt19937& generator, int document_count,
+                                              int vocabulary_size, int words_per_document) {
+    CorpusShape shape;
+    shape.document_count = document_count;
+    shape.vocabulary_size = vocabulary_size;
+    shape.min_words = shape.max_words = words_per_document;
+    return MakeRandomDocuments(generator, shape);
+}
+
+std::string MakeRandomQuery(std::mt19937& generator, int vocabulary_size) {
+    return "w"s + std::to_string(generator() % vocabulary_size)
+        + " w"s + std::to_string(generator() % vocabulary_size)
+        + " -w"s + std::to_string(generator() % vocabulary_size);
+}
+
+// Documents tied in both relevance and rating may come in any order, so only those are compared
+void AssertEqualRanking(const std::vector<Document>& expected, const std::vector<Document>& actual,
+                        const std::string& query) {
+    ASSERT_EQUAL_HINT(expected.size(), actual.size(), query);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQUAL_HINT(expected[i].relevance, actual[i].relevance, query);
+        ASSERT_EQUAL_HINT(expected[i].rating, actual[i].rating, query);
+    }
+}
+
+void TestMatchDocumentsMatchesMatchDocument() {
+    const int vocabulary_size = 40;
+    std::mt19937 generator(3);
+    SearchServer search_server("a"s);
+    for (const TestDocument& document : MakeRandomDocuments(generator, 300, vocabulary_size, 10)) {
+        search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    search_server.RemoveDocument(9);
+
+    std::vector<int> document_ids;
+    for (int i = 0; i < 100; ++i) {
+        document_ids.push_back(static_cast<int>(generator() % 300) / 9 * 9 + 1);
+    }
+    for (int i = 0; i < 20; ++i) {
+        const std::string query = MakeRandomQuery(generator, vocabulary_size) + (i % 2 == 0 ? " +w1"s : ""s);
+        const auto sequential_matches = search_server.MatchDocuments(query, document_ids);
+        const auto parallel_matches = search_server.MatchDocuments(std::execution::par, query, document_ids);
+        ASSERT_EQUAL(sequential_matches.size(), document_ids.size());
+        ASSERT_EQUAL(parallel_matches.size(), document_ids.size());
+        for (size_t j = 0; j < document_ids.size(); ++j) {
+            const Match_Document expected = search_server.MatchDocument(query, document_ids[j]);
+            ASSERT_HINT(sequential_matches[j] == expected, query);
+            ASSERT_HINT(parallel_matches[j] == expected, query);
+        }
+    }
+
+    // Unknown and removed ids are reported as MatchDocument reports them, not by terminating
+    for (const int document_id : { 9999, 9 }) {
+        const std::vector<int> invalid_ids = { 3, document_id };
+        int reported_count = 0;
+        try {
+            search_server.MatchDocuments("w1"s, invalid_ids);
+        }
+        catch (const std::out_of_range&) {
+            ++reported_count;
+        }
+        try {
+            search_server.MatchDocuments(std::execution::par, "w1"s, invalid_ids);
+        }
+        catch (const std::out_of_range&) {
+            ++reported_count;
+        }
+        try {
+            search_server.MatchDocument("w1"s, document_id);
+        }
+        catch (const std::out_of_range&) {
+            ++reported_count;
+        }
+        ASSERT_EQUAL(reported_count, 3);
+    }
+}
+
+void TestStopWordSetMembership() {
+    std::set<std::string, std::less<>> stop_words;
+    for (int i = 0; i < 500; ++i) {
+        stop_words.insert("s"s + std::to_string(i * 7));
+    }
+    const StopWordSet stop_word_set(stop_words);
+    ASSERT_EQUAL(stop_word_set.size(), stop_words.size());
+    for (int i = 0; i < 3500; ++i) {
+        const std::string word = "s"s + std::to_string(i);
+        ASSERT_EQUAL_HINT(stop_word_set.count(word), i % 7 == 0, word);
+    }
+    for (const std::string_view word : { ""sv, "s"sv, "s00"sv, "S7"sv, "s3493x"sv, "7"sv }) {
+        ASSERT_HINT(!stop_word_set.count(word), std::string(word));
+    }
+
+    const StopWordSet single_word_set(std::set<std::string, std::less<>>{ "and"s });
+    ASSERT(single_word_set.count("and"sv));
+    ASSERT(!single_word_set.count("an"sv));
+    ASSERT(!single_word_set.count(""sv));
+    const StopWordSet empty_set;
+    ASSERT_EQUAL(empty_set.size(), 0u);
+    ASSERT(!empty_set.count("and"sv));
+    ASSERT(!empty_set.count(""sv));
+
+    static constexpr auto STATIC_STOP_WORDS = MakeStaticStopWordSet("and", "with", "in", "", "and");
+    static_assert(STATIC_STOP_WORDS.count("with") && !STATIC_STOP_WORDS.count("within")
+                  && !STATIC_STOP_WORDS.count(""));
+    static_assert(!MakeStaticStopWordSet().count("and"));
+    ASSERT_EQUAL(STATIC_STOP_WORDS.GetFingerprint(),
+                 StopWordSet(MakeUniqueNonEmptyStrings(STATIC_STOP_WORDS)).GetFingerprint());
+
+    // Documents tokenized with the compile-time set index the same words
+    SearchServer static_server(STATIC_STOP_WORDS);
+    SearchServer runtime_server("in with and"s);
+    static_server.AddDocument(STATIC_STOP_WORDS, 1, "cat in the hat with and"s, DocumentStatus::ACTUAL, { 1 });
+    runtime_server.AddDocument(1, "cat in the hat with and"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT(static_server.GetWordFrequencies(1) == runtime_server.GetWordFrequencies(1));
+    ASSERT_EQUAL(static_server.GetWordFrequencies(1).size(), 3u);
+
+    bool is_mismatch_reported = false;
+    try {
+        runtime_server.AddDocument(MakeStaticStopWordSet("in", "with"), 2, "cat"s, DocumentStatus::ACTUAL, { 1 });
+    }
+    catch (const std::invalid_argument&) {
+        is_mismatch_reported = true;
+    }
+    ASSERT(is_mismatch_reported);
+}
+
+// Every operation is applied to both servers, results are compared after each phase
+void TestShardedServerMatchesSingleServer() {
+    const int vocabulary_size = 50;
+    std::mt19937 generator(13);
+    SearchServer single_server("a"s);
+    ShardedSearchServer sharded_server(4, "a"s);
+    CorpusShape shape;
+    shape.document_count = 2000;
+    shape.vocabulary_size = vocabulary_size;
+    shape.min_words = shape.max_words = 6;
+    shape.status_count = 4;
+    std::vector<TestDocument> documents = MakeRandomDocuments(generator, shape);
+    for (const TestDocument& document : documents) {
+        single_server.AddDocument(document.id, document.text, document.status, document.ratings);
+        sharded_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+
+    const auto predicate = [] (int document_id, DocumentStatus status, int rating) {
+        return status != DocumentStatus::REMOVED && rating % 3 != 0;
+    };
+    const auto compare = [&] {
+        ASSERT_EQUAL(sharded_server.GetDocumentCount(), single_server.GetDocumentCount());
+        for (int i = 0; i < 60; ++i) {
+            std::string query = MakeRandomQuery(generator, vocabulary_size);
+            if (i % 3 == 0) {
+                query += " +w"s + std::to_string(generator() % 10);
+            }
+            AssertEqualRanking(single_server.FindTopDocuments(query), sharded_server.FindTopDocuments(query), query);
+            for (int status = 0; status < 4; ++status) {
+                AssertEqualRanking(single_server.FindTopDocuments(query, static_cast<DocumentStatus>(status)),
+                                   sharded_server.FindTopDocuments(query, static_cast<DocumentStatus>(status)), query);
+            }
+            AssertEqualRanking(single_server.FindTopDocuments(query, predicate),
+                               sharded_server.FindTopDocuments(query, predicate), query);
+            const int document_id = documents[generator() % documents.size()].id;
+            ASSERT_HINT(single_server.MatchDocument(query, document_id) == sharded_server.MatchDocument(query, document_id),
+                        query);
+        }
+    };
+    compare();
+
+    for (int i = 0; i < 600; ++i) {
+        const int document_id = static_cast<int>(generator() % documents.size());
+        if (single_server.GetWordFrequencies(document_id).empty()) {
+            continue;
+        }
+        if (i % 3 == 0) {
+            single_server.RemoveDocument(document_id);
+            sharded_server.RemoveDocument(document_id);
+        }
+        else if (i % 3 == 1) {
+            const auto status = static_cast<DocumentStatus>(generator() % 4);
+            single_server.SetDocumentStatus(document_id, status);
+            sharded_server.SetDocumentStatus(document_id, status);
+        }
+        else {
+            const std::string text = documents[generator() % documents.size()].text;
+            single_server.UpdateDocument(document_id, text, DocumentStatus::ACTUAL, { i });
+            sharded_server.UpdateDocument(document_id, text, DocumentStatus::ACTUAL, { i });
+        }
+    }
+    documents.erase(std::remove_if(documents.begin(), documents.end(), [&] (const TestDocument& document) {
+        return single_server.GetWordFrequencies(document.id).empty();
+    }), documents.end());
+    compare();
+}
+
+// Shards run in child processes forked before anything starts the parallel
+// algorithms' thread pool, the answers are compared with a single server
+void TestShardCoordinatorMatchesSingleServer() {
+    const int shard_count = 3;
+    const int vocabulary_size = 100;
+    std::mt19937 generator(5);
+    const std::vector<TestDocument> documents = MakeRandomDocuments(generator, 600, vocabulary_size, 8);
+
+    // The tcp shard binds port 0, every shard reports its bound address through
+    // a pipe once it listens, so the coordinator can connect right away
+    std::vector<std::string> addresses;
+    std::vector<pid_t> shard_pids;
+    for (int shard = 0; shard < shard_count; ++shard) {
+        const std::string address = shard == 0
+            ? "tcp:127.0.0.1:0"s
+            : "unix:/tmp/search_server_test_"s + std::to_string(getpid()) + "_"s + std::to_string(shard);
+        int address_pipe[2];
+        ASSERT(pipe(address_pipe) == 0);
+        const pid_t pid = fork();
+        ASSERT(pid >= 0);
+        if (pid == 0) {
+            close(address_pipe[0]);
+            SearchServer search_server("a"s);
+            for (const TestDocument& document : documents) {
+                if (document.id % shard_count == shard) {
+                    search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+                }
+            }
+            ShardServer shard_server(search_server, address);
+            const std::string bound_address = shard_server.GetAddress();
+            if (write(address_pipe[1], bound_address.data(), bound_address.size()) < 0) {
+                _exit(1);
+            }
+            close(address_pipe[1]);
+            shard_server.Run();
+            _exit(0);
+        }
+        close(address_pipe[1]);
+        std::string bound_address;
+        char buffer[256];
+        ssize_t read_size = 0;
+        while ((read_size = read(address_pipe[0], buffer, sizeof(buffer))) > 0) {
+            bound_address.append(buffer, static_cast<size_t>(read_size));
+        }
+        close(address_pipe[0]);
+        ASSERT_HINT(bound_address.rfind(address.substr(0, 5), 0) == 0, bound_address);
+        addresses.push_back(bound_address);
+        shard_pids.push_back(pid);
+    }
+    ASSERT(addresses[0] != "tcp:127.0.0.1:0"s);
+
+    SearchServer single_server("a"s);
+    for (const TestDocument& document : documents) {
+        single_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    ShardCoordinator coordinator(addresses, std::chrono::milliseconds(2000));
+
+    for (int i = 0; i < 50; ++i) {
+        const std::string query = MakeRandomQuery(generator, vocabulary_size);
+        const CoordinatedSearchResult result = coordinator.FindTopDocuments(query, DocumentStatus::IRRELEVANT);
+        ASSERT_EQUAL(result.unavailable_shard_count, 0u);
+        AssertEqualRanking(single_server.FindTopDocuments(query, DocumentStatus::IRRELEVANT), result.documents, query);
+    }
+
+    // Callers on several threads share the coordinator through its connection pool
+    std::vector<std::thread> callers;
+    std::vector<std::string> queries;
+    for (int i = 0; i < 80; ++i) {
+        queries.push_back(MakeRandomQuery(generator, vocabulary_size));
+    }
+    for (int caller = 0; caller < 4; ++caller) {
+        callers.emplace_back([&, caller] {
+            for (size_t i = caller; i < queries.size(); i += 4) {
+                const CoordinatedSearchResult result = coordinator.FindTopDocuments(queries[i]);
+                ASSERT_EQUAL(result.unavailable_shard_count, 0u);
+                AssertEqualRanking(single_server.FindTopDocuments(queries[i]), result.documents, queries[i]);
+            }
+        });
+    }
+    for (std::thread& caller : callers) {
+        caller.join();
+    }
+
+    const auto match = coordinator.MatchDocument("w1 w2 w3 w4 w5"s, 7);
+    ASSERT(match.has_value());
+    const auto [expected_words, expected_status] = single_server.MatchDocument("w1 w2 w3 w4 w5"s, 7);
+    const auto& [words, status] = *match;
+    ASSERT_EQUAL(words.size(), expected_words.size());
+    for (size_t i = 0; i < words.size(); ++i) {
+        ASSERT_EQUAL(words[i], expected_words[i]);
+    }
+    ASSERT(status == expected_status);
+
+    bool is_invalid_query_reported = false;
+    try {
+        coordinator.FindTopDocuments("--w1"s);
+    }
+    catch (const std::invalid_argument&) {
+        is_invalid_query_reported = true;
+    }
+    ASSERT(is_invalid_query_reported);
+
+    kill(shard_pids[1], SIGKILL);
+    waitpid(shard_pids[1], nullptr, 0);
+    ASSERT_EQUAL(coordinator.FindTopDocuments("w1 w2"s).unavailable_shard_count, 1u);
+    ASSERT(!coordinator.MatchDocument("w1"s, 1).has_value());
+
+    for (const int shard : { 0, 2 }) {
+        kill(shard_pids[shard], SIGKILL);
+        waitpid(shard_pids[shard], nullptr, 0);
+    }
+    for (int shard = 1; shard < shard_count; ++shard) {
+        unlink(addresses[shard].substr("unix:"s.size()).c_str());
+    }
+}
+
+void TestSearchWithinLimits() {
+    const int vocabulary_size = 30;
+    std::mt19937 generator(17);
+    SearchServer search_server("a"s);
+    for (const TestDocument& document : MakeRandomDocuments(generator, 5000, vocabulary_size, 8)) {
+        search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    const auto is_even = [] (int document_id, DocumentStatus status, int rating) {
+        return document_id % 2 == 0;
+    };
+
+    // Without limits the search runs to the end and equals FindTopDocuments
+    for (int i = 0; i < 30; ++i) {
+        const std::string query = MakeRandomQuery(generator, vocabulary_size);
+        const PartialSearchResult result = search_server.FindTopDocumentsWithin(std::execution::seq, query, is_even, {});
+        ASSERT(!result.truncated);
+        AssertEqualRanking(search_server.FindTopDocuments(query, is_even), result.documents, query);
+        const PartialSearchResult parallel_result
+            = search_server.FindTopDocumentsWithin(std::execution::par, query, is_even, {});
+        ASSERT(!parallel_result.truncated);
+        AssertEqualRanking(search_server.FindTopDocuments(query, is_even), parallel_result.documents, query);
+        const PartialSearchResult async_result = search_server.FindTopDocumentsAsync(query, {}).get();
+        ASSERT(!async_result.truncated);
+        AssertEqualRanking(search_server.FindTopDocuments(query), async_result.documents, query);
+        const PartialSearchResult async_status_result
+            = search_server.FindTopDocumentsAsync(query, DocumentStatus::IRRELEVANT, {}).get();
+        AssertEqualRanking(search_server.FindTopDocuments(query, DocumentStatus::IRRELEVANT),
+                           async_status_result.documents, query);
+    }
+
+    // A cancelled token or a deadline already passed stops the search before any posting
+    SearchLimits cancelled_limits;
+    cancelled_limits.cancellation.Cancel();
+    SearchLimits expired_limits;
+    expired_limits.deadline = std::chrono::steady_clock::now() - std::chrono::milliseconds(1);
+    for (const SearchLimits& limits : { cancelled_limits, expired_limits }) {
+        const PartialSearchResult result = search_server.FindTopDocumentsWithin(std::execution::seq, "w1 w2"s, is_even, limits);
+        ASSERT(result.truncated);
+        ASSERT(result.documents.empty());
+        ASSERT(search_server.FindTopDocumentsAsync("w1 w2"s, limits).get().truncated);
+    }
+
+    // The predicate cancels the search in the middle of the plus words, so the
+    // postings of the minus words are never walked
+    for (int i = 0; i < 30; ++i) {
+        const std::string query = "w"s + std::to_string(i % vocabulary_size) + " w"s + std::to_string((i + 7) % vocabulary_size)
+            + " -w"s + std::to_string((i + 3) % vocabulary_size) + " -w"s + std::to_string((i + 11) % vocabulary_size);
+        SearchLimits limits;
+        int visited_count = 0;
+        const PartialSearchResult result = search_server.FindTopDocumentsWithin(std::execution::seq, query,
+            [&] (int document_id, DocumentStatus status, int rating) {
+                if (++visited_count == 1500) {
+                    limits.cancellation.Cancel();
+                }
+                return true;
+            }, limits);
+        ASSERT_HINT(result.truncated, query);
+        ASSERT_HINT(!result.documents.empty(), query);
+        for (const Document& document : result.documents) {
+            const auto word_freqs = search_server.GetWordFrequencies(document.id);
+            ASSERT_HINT(word_freqs.count("w"s + std::to_string((i + 3) % vocabulary_size)) == 0, query);
+            ASSERT_HINT(word_freqs.count("w"s + std::to_string((i + 11) % vocabulary_size)) == 0, query);
+        }
+    }
+}
+
+// Small filters are intersected with the id sets of the words, large ones are
+// checked posting by posting, both must equal the same predicate query
+void TestFilterMatchesPredicate() {
+    const int vocabulary_size = 40;
+    std::mt19937 generator(19);
+    SearchServer search_server("a"s);
+    CorpusShape shape;
+    shape.document_count = 3000;
+    shape.vocabulary_size = vocabulary_size;
+    shape.id_step = 37;
+    for (const TestDocument& document : MakeRandomDocuments(generator, shape)) {
+        search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    for (const int rating_limit : { -8, 0, 30 }) {
+        const auto predicate = [rating_limit] (int document_id, DocumentStatus status, int rating) {
+            return rating < rating_limit;
+        };
+        search_server.RegisterFilter("low"s, predicate);
+        for (int i = 0; i < 300; ++i) {
+            if (i % 30 == 0) {
+                // Removed and changed documents leave both the filter and the word id sets
+                const int document_id = static_cast<int>(generator() % 3000) * 37;
+                search_server.RemoveDocument(document_id);
+                search_server.AddDocument(document_id, "w1 w2 w3"s, DocumentStatus::ACTUAL, { rating_limit - 1 });
+                const int updated_id = static_cast<int>(generator() % 3000) * 37;
+                search_server.UpdateDocument(updated_id, "w4 w5"s, DocumentStatus::BANNED, { rating_limit - 1 });
+            }
+            const std::string query = MakeRandomQuery(generator, vocabulary_size);
+            AssertEqualRanking(search_server.FindTopDocuments(query, predicate),
+                               search_server.FindTopDocumentsWithFilter(query, "low"s), query);
+            AssertEqualRanking(search_server.FindTopDocuments(std::execution::par, query, predicate),
+                               search_server.FindTopDocumentsWithFilter(std::execution::par, query, "low"s), query);
+        }
+    }
+}
+
+void TestDocumentSlotMapMatchesStdMap() {
+    std::mt19937 generator(11);
+    DocumentSlotMap slot_map;
+    std::map<int, uint32_t> expected;
+    for (uint32_t step = 0; step < 20000; ++step) {
+        // Ids cluster so that erasing shifts long probe runs
+        const int document_id = static_cast<int>(generator() % 3000) * (step % 2 == 0 ? 1 : 715827);
+        if (expected.count(document_id) > 0) {
+            ASSERT_EQUAL(slot_map.At(document_id), expected.at(document_id));
+            if (generator() % 2 == 0) {
+                slot_map.Erase(document_id);
+                expected.erase(document_id);
+            }
+        }
+        else {
+            slot_map.Insert(document_id, step);
+            expected.emplace(document_id, step);
+        }
+    }
+    ASSERT_EQUAL(slot_map.GetSize(), expected.size());
+    for (const auto [document_id, slot] : expected) {
+        ASSERT_EQUAL(slot_map.At(document_id), slot);
+    }
+    bool is_unknown_id_reported = false;
+    try {
+        slot_map.At(-1);
+    }
+    catch (const std::out_of_range&) {
+        is_unknown_id_reported = true;
+    }
+    ASSERT(is_unknown_id_reported);
+}
+
+// Attribute columns are indexed by dense slots, not by the ids themselves
+void TestSparseDocumentIdsUseDenseSlots() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(2000000000, "white cat"s, DocumentStatus::ACTUAL, { 5 });
+    search_server.AddDocument(5, "black cat"s, DocumentStatus::BANNED, { 3 });
+    ASSERT(search_server.GetMemoryUsage().attributes < 4096);
+
+    search_server.RemoveDocument(5);
+    search_server.AddDocument(1000000, "grey cat"s, DocumentStatus::ACTUAL, { 7 });
+    search_server.SetDocumentRating(2000000000, 9);
+
+    const std::vector<Document> documents = search_server.FindTopDocuments("cat"s);
+    ASSERT_EQUAL(documents.size(), 2u);
+    ASSERT_EQUAL(documents[0].id, 2000000000);
+    ASSERT_EQUAL(documents[0].rating, 9);
+    ASSERT_EQUAL(documents[1].id, 1000000);
+    ASSERT_EQUAL(documents[1].rating, 7);
+    ASSERT(search_server.FindTopDocuments("cat"s, DocumentStatus::BANNED).empty());
+    ASSERT(std::get<1>(search_server.MatchDocument("grey"s, 1000000)) == DocumentStatus::ACTUAL);
+}
+
+void TestCompactForwardIndexWordFrequencies() {
+    IndexOptions options;
+    options.compact_forward_index = true;
+    SearchServer compact_server("and"s, options);
+    SearchServer full_server("and"s);
+    for (SearchServer* search_server : { &compact_server, &full_server }) {
+        search_server->AddDocument(1, "white cat and white hat"s, DocumentStatus::ACTUAL, { 1 });
+        search_server->AddDocument(2, "curly dog"s, DocumentStatus::BANNED, { 2 });
+    }
+
+    // Maps rebuilt one after another must not alias each other
+    const auto& first_word_freqs = compact_server.GetWordFrequencies(1);
+    const auto& second_word_freqs = compact_server.GetWordFrequencies(2);
+    ASSERT(first_word_freqs == full_server.GetWordFrequencies(1));
+    ASSERT(second_word_freqs == full_server.GetWordFrequencies(2));
+    ASSERT(&compact_server.GetWordFrequencies(1) == &first_word_freqs);
+    ASSERT(compact_server.GetWordFrequencies(3).empty());
+
+    // Updates and removals drop the rebuilt maps
+    for (SearchServer* search_server : { &compact_server, &full_server }) {
+        search_server->UpdateDocument(1, "black cat"s, DocumentStatus::IRRELEVANT, { 3 });
+        search_server->RemoveDocument(2);
+    }
+    ASSERT(compact_server.GetWordFrequencies(1) == full_server.GetWordFrequencies(1));
+    ASSERT_EQUAL(compact_server.GetWordFrequencies(1).size(), 2u);
+    ASSERT(compact_server.GetWordFrequencies(2).empty());
+    ASSERT(compact_server.GetDocumentWords(1) == full_server.GetDocumentWords(1));
+
+    // Duplicates are found from the words alone in the compact mode too
+    compact_server.AddDocument(4, "cat black and cat"s, DocumentStatus::ACTUAL, { 4 });
+    RemoveDuplicates(compact_server);
+    ASSERT_EQUAL(compact_server.GetDocumentCount(), 1);
+    ASSERT(compact_server.GetWordFrequencies(4).empty());
+}
+
+// Corpus lines with a blank line after every hundredth one
+std::string MakeCorpusText(int document_count) {
+    std::string text;
+    for (int id = 0; id < document_count; ++id) {
+        text += std::to_string(id) + (id % 3 == 0 ? "\tBANNED\t"s : "\tACTUAL\t"s) + "1 "s + std::to_string(id % 10)
+            + "\tcat dog w"s + std::to_string(id % 7) + " w"s + std::to_string(id % 1000) + " and\r\n"s;
+        if (id % 100 == 0) {
+            text += "\n"s;
+        }
+    }
+    return text;
+}
+
+// Loads the text through a fifo, which cannot be mapped and is read in chunks
+size_t LoadCorpusThroughFifo(SearchServer& search_server, const std::string& text) {
+    const std::string path = "/tmp/search_server_test_fifo_"s + std::to_string(getpid());
+    unlink(path.c_str());
+    ASSERT(mkfifo(path.c_str(), 0600) == 0);
+    std::thread writer([&] {
+        std::ofstream(path) << text;
+    });
+    size_t document_count = 0;
+    try {
+        document_count = LoadCorpus(search_server, path, 2);
+    }
+    catch (...) {
+        // A failed load stops reading, so texts expected to fail must fit in the pipe buffer
+        writer.join();
+        unlink(path.c_str());
+        throw;
+    }
+    writer.join();
+    unlink(path.c_str());
+    return document_count;
+}
+
+void TestLoadCorpusFromMappedFileAndStream() {
+    const int document_count = 30000;
+    const std::string text = MakeCorpusText(document_count);
+    // Longer than one read chunk, so the stream carries lines across chunks
+    ASSERT(text.size() > (1u << 20));
+    const std::string path = "/tmp/search_server_test_corpus_"s + std::to_string(getpid());
+    std::ofstream(path) << text;
+
+    SearchServer mapped_server("and"s);
+    ASSERT_EQUAL(LoadCorpus(mapped_server, path), static_cast<size_t>(document_count));
+    unlink(path.c_str());
+    SearchServer streamed_server("and"s);
+    ASSERT_EQUAL(LoadCorpusThroughFifo(streamed_server, text), static_cast<size_t>(document_count));
+
+    SearchServer expected_server("and"s);
+    for (int id = 0; id < document_count; ++id) {
+        expected_server.AddDocument(id, "cat dog w"s + std::to_string(id % 7) + " w"s + std::to_string(id % 1000) + " and"s,
+                                    id % 3 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { 1, id % 10 });
+    }
+    for (const std::string& query : { "w3 cat"s, "w17 -w3"s, "w999 w0 w6"s }) {
+        const auto expected = expected_server.FindTopDocuments(query);
+        AssertEqualRanking(expected, mapped_server.FindTopDocuments(query), query);
+        AssertEqualRanking(expected, streamed_server.FindTopDocuments(query), query);
+    }
+}
+
+void TestLoadCorpusReportsLineNumbers() {
+    // Line 250 is the 247th document after blank lines at 2 and 103 and 204
+    std::string text = MakeCorpusText(300);
+    size_t line_start = 0;
+    for (int line = 1; line < 250; ++line) {
+        line_start = text.find('\n', line_start) + 1;
+    }
+    text.replace(line_start, text.find('\t', line_start) - line_start, "bad_id"s);
+
+    std::string message;
+    try {
+        SearchServer search_server("and"s);
+        LoadCorpusThroughFifo(search_server, text);
+    }
+    catch (const std::invalid_argument& e) {
+        message = e.what();
+    }
+    ASSERT_HINT(message.find("Corpus line 250:"s) == 0, message);
+}
+
+// Batches of lines are tokenized in parallel but indexed in file order, so the
+// failing line and the documents added before it do not depend on thread timing
+void TestLoadCorpusIndexesInFileOrder() {
+    std::string text = MakeCorpusText(6000);
+    const auto replace_id = [&] (int document_id, const std::string& new_id) {
+        const size_t line_start = text.find("\n"s + std::to_string(document_id) + "\t"s) + 1;
+        text.replace(line_start, std::to_string(document_id).size(), new_id);
+        return std::count(text.begin(), text.begin() + line_start, '\n') + 1;
+    };
+    // The duplicate is several batches after the first document with its id,
+    // the bad id one batch after the duplicate
+    const auto duplicate_line = replace_id(5000, "17"s);
+    replace_id(5600, "bad_id"s);
+    const std::string path = "/tmp/search_server_test_corpus_"s + std::to_string(getpid());
+    std::ofstream(path) << text;
+
+    for (int i = 0; i < 5; ++i) {
+        SearchServer search_server("and"s);
+        std::string message;
+        try {
+            LoadCorpus(search_server, path, 8);
+        }
+        catch (const std::invalid_argument& e) {
+            message = e.what();
+        }
+        ASSERT_HINT(message == "Corpus line "s + std::to_string(duplicate_line) + ": Invalid document_id"s, message);
+        ASSERT_EQUAL(search_server.GetDocumentCount(), 5000);
+        ASSERT(std::get<0>(search_server.MatchDocument("w17"s, 17)).size() == 1);
+    }
+    unlink(path.c_str());
+}
+
+// Skewed word frequencies give long posting lists with many impact levels
+void TestImpactOrderedPostingsMatchDefaultLayout() {
+    std::mt19937 generator(7);
+    IndexOptions options;
+    options.impact_ordered_postings = true;
+    SearchServer default_server("and"s);
+    SearchServer impact_server("and"s, options);
+    const int vocabulary_size = 60;
+    CorpusShape shape;
+    shape.document_count = 3000;
+    shape.vocabulary_size = vocabulary_size;
+    shape.min_words = 1;
+    shape.max_words = 20;
+    shape.word_decay = 0.1;
+    shape.status_count = 4;
+    shape.min_rating = -50;
+    shape.rating_count = 100;
+    for (const TestDocument& document : MakeRandomDocuments(generator, shape)) {
+        default_server.AddDocument(document.id, document.text, document.status, document.ratings);
+        impact_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    for (int id = 0; id < 3000; id += 7) {
+        default_server.RemoveDocument(id);
+        impact_server.RemoveDocument(std::execution::par, id);
+    }
+
+    const auto predicate = [] (int document_id, DocumentStatus status, int rating) {
+        return document_id % 3 != 0 && rating > -10;
+    };
+    for (int i = 0; i < 300; ++i) {
+        std::string query;
+        const int word_count = 1 + generator() % 6;
+        for (int j = 0; j < word_count; ++j) {
+            query += "w"s + std::to_string(generator() % vocabulary_size) + " "s;
+        }
+        if (i % 3 == 0) {
+            query += "-w"s + std::to_string(generator() % vocabulary_size);
+        }
+        AssertEqualRanking(default_server.FindTopDocuments(query), impact_server.FindTopDocuments(query), query);
+        AssertEqualRanking(default_server.FindTopDocuments(query, DocumentStatus::BANNED),
+                           impact_server.FindTopDocuments(std::execution::seq, query, DocumentStatus::BANNED), query);
+        AssertEqualRanking(default_server.FindTopDocuments(query, predicate),
+                           impact_server.FindTopDocuments(std::execution::par, query, predicate), query);
+    }
+}
+
+// Sizes past 2 * 16384 make the parallel radix sort scatter several chunks;
+// few distinct relevances and ratings give long runs of equal keys
+void TestSortDocumentsMatchesStableSort() {
+    std::mt19937 generator(38);
+    const std::vector<double> relevances = { -1.0, 0.0, 0.25, 0.25 + COMPARISON_LIMIT / 4, 0.5, 1e12 };
+    const std::vector<int> ratings = { std::numeric_limits<int>::min(), -7, 0, 7, std::numeric_limits<int>::max() };
+    for (const size_t size : { 0u, 1u, 2u, 1000u, 2u * 16384u + 777u, 5u * 16384u + 3u }) {
+        std::vector<Document> documents;
+        for (size_t i = 0; i < size; ++i) {
+            documents.emplace_back(static_cast<int>(i), relevances[generator() % relevances.size()],
+                                   ratings[generator() % ratings.size()]);
+        }
+        std::vector<Document> expected = documents;
+        std::stable_sort(expected.begin(), expected.end(), [] (const Document& lhs, const Document& rhs) {
+            return MakeDocumentOrderKey(lhs) < MakeDocumentOrderKey(rhs);
+        });
+
+        std::vector<Document> sequenced = documents;
+        SortDocuments(std::execution::seq, sequenced);
+        std::vector<Document> parallel = documents;
+        SortDocuments(std::execution::par, parallel);
+        for (const std::vector<Document>* sorted : { &sequenced, &parallel }) {
+            ASSERT_EQUAL(sorted->size(), size);
+            for (size_t i = 0; i < size; ++i) {
+                ASSERT_EQUAL((*sorted)[i].id, expected[i].id);
+                ASSERT_EQUAL((*sorted)[i].relevance, expected[i].relevance);
+                ASSERT_EQUAL((*sorted)[i].rating, expected[i].rating);
+            }
+        }
+    }
+}
+
+// +word queries against the plain query restricted to documents whose text
+// holds every required word, checked word by word on the source texts
+void TestRequiredWordsMatchBruteForceIntersection() {
+    std::mt19937 generator(11);
+    const int vocabulary_size = 30;
+    SearchServer search_server("and"s);
+    CorpusShape shape;
+    shape.document_count = 4000;
+    shape.vocabulary_size = vocabulary_size;
+    shape.min_words = 1;
+    shape.max_words = 15;
+    shape.word_decay = 0.15;
+    shape.status_count = 4;
+    shape.min_rating = 0;
+    shape.rating_count = 1000;
+    std::vector<std::set<std::string>> document_words;
+    for (const TestDocument& document : MakeRandomDocuments(generator, shape)) {
+        search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+        const std::vector<std::string_view> words = SplitIntoWords(document.text);
+        document_words.emplace_back(words.begin(), words.end());
+    }
+
+    for (int i = 0; i < 200; ++i) {
+        std::vector<std::string> required_words;
+        std::string conjunctive_query;
+        std::string plain_query;
+        const int required_count = 1 + generator() % 3;
+        for (int j = 0; j < required_count; ++j) {
+            required_words.push_back("w"s + std::to_string(generator() % 12));
+            conjunctive_query += "+"s + required_words.back() + " "s;
+            plain_query += required_words.back() + " "s;
+        }
+        const int optional_count = generator() % 3;
+        for (int j = 0; j < optional_count; ++j) {
+            const std::string word = "w"s + std::to_string(generator() % vocabulary_size);
+            conjunctive_query += word + " "s;
+            plain_query += word + " "s;
+        }
+        if (i % 4 == 0) {
+            const std::string word = "-w"s + std::to_string(10 + generator() % 10);
+            conjunctive_query += word;
+            plain_query += word;
+        }
+
+        const auto has_required_words = [&] (int document_id) {
+            return std::all_of(required_words.begin(), required_words.end(), [&] (const std::string& word) {
+                return document_words[document_id].count(word) > 0;
+            });
+        };
+        AssertEqualRanking(
+            search_server.FindTopDocuments(plain_query, [&] (int document_id, DocumentStatus status, int rating) {
+                return status == DocumentStatus::ACTUAL && has_required_words(document_id);
+            }),
+            search_server.FindTopDocuments(conjunctive_query), conjunctive_query);
+        AssertEqualRanking(
+            search_server.FindTopDocuments(plain_query, [&] (int document_id, DocumentStatus status, int rating) {
+                return rating > 300 && has_required_words(document_id);
+            }),
+            search_server.FindTopDocuments(std::execution::par, conjunctive_query,
+                [] (int document_id, DocumentStatus status, int rating) { return rating > 300; }),
+            conjunctive_query);
+        for (const Document& document : search_server.FindTopDocuments(conjunctive_query, DocumentStatus::BANNED)) {
+            ASSERT_HINT(has_required_words(document.id), conjunctive_query);
+        }
+
+        const int document_id = generator() % 4000;
+        const auto [matched_words, status] = search_server.MatchDocument(conjunctive_query, document_id);
+        if (has_required_words(document_id)) {
+            ASSERT(matched_words == std::get<0>(search_server.MatchDocument(plain_query, document_id)));
+        }
+        else {
+            ASSERT(matched_words.empty());
+        }
+    }
+    ASSERT(search_server.FindTopDocuments("+nothing w1"s).empty());
+}
+
+// In-place updates must leave every index in the state removing the
+// document and adding it again would
+void TestInPlaceUpdatesMatchRemoveAndAdd() {
+    CorpusShape shape;
+    shape.document_count = 500;
+    shape.vocabulary_size = 25;
+    shape.min_words = 1;
+    shape.max_words = 12;
+    shape.status_count = 4;
+    shape.min_rating = 0;
+    shape.rating_count = 10;
+    const auto is_good = [] (int document_id, DocumentStatus status, int rating) {
+        return status == DocumentStatus::ACTUAL && rating > 3;
+    };
+
+    for (int layout = 0; layout < 3; ++layout) {
+        IndexOptions options;
+        options.compact_forward_index = layout == 1;
+        options.impact_ordered_postings = layout == 2;
+        SearchServer updated_server("w0"s, options);
+        SearchServer readded_server("w0"s, options);
+        updated_server.RegisterFilter("good"s, is_good);
+        readded_server.RegisterFilter("good"s, is_good);
+
+        std::mt19937 generator(layout + 1);
+        std::vector<TestDocument> documents = MakeRandomDocuments(generator, shape);
+        for (const TestDocument& document : documents) {
+            updated_server.AddDocument(document.id, document.text, document.status, document.ratings);
+            readded_server.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+
+        for (int step = 0; step < 2000; ++step) {
+            TestDocument& document = documents[generator() % documents.size()];
+            const int operation = generator() % 3;
+            if (operation == 0) {
+                document.status = static_cast<DocumentStatus>(generator() % 4);
+                updated_server.SetDocumentStatus(document.id, document.status);
+            }
+            else if (operation == 1) {
+                document.ratings = { static_cast<int>(generator() % 10) };
+                updated_server.SetDocumentRating(document.id, document.ratings[0]);
+            }
+            else {
+                // Some updates keep the text and change only the attributes
+                if (generator() % 4 != 0) {
+                    document.text = MakeRandomText(generator, shape);
+                }
+                document.status = static_cast<DocumentStatus>(generator() % 4);
+                document.ratings = { static_cast<int>(generator() % 10) };
+                updated_server.UpdateDocument(document.id, document.text, document.status, document.ratings);
+            }
+            readded_server.RemoveDocument(document.id);
+            readded_server.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+
+        for (int i = 0; i < 100; ++i) {
+            const std::string query = MakeRandomText(generator, shape) + (i % 3 == 0 ? "-w"s + std::to_string(generator() % 25) : ""s);
+            for (int status = 0; status < 4; ++status) {
+                const auto expected = readded_server.FindAllDocuments(query, static_cast<DocumentStatus>(status));
+                const auto actual = updated_server.FindAllDocuments(query, static_cast<DocumentStatus>(status));
+                ASSERT_EQUAL_HINT(expected.size(), actual.size(), query);
+                for (size_t j = 0; j < expected.size(); ++j) {
+                    ASSERT_EQUAL_HINT(expected[j].id, actual[j].id, query);
+                    ASSERT_EQUAL_HINT(expected[j].relevance, actual[j].relevance, query);
+                    ASSERT_EQUAL_HINT(expected[j].rating, actual[j].rating, query);
+                }
+                AssertEqualRanking(readded_server.FindTopDocuments(query, static_cast<DocumentStatus>(status)),
+                                   updated_server.FindTopDocuments(query, static_cast<DocumentStatus>(status)), query);
+            }
+            AssertEqualRanking(readded_server.FindTopDocumentsWithFilter(query, "good"s),
+                               updated_server.FindTopDocumentsWithFilter(query, "good"s), query);
+            const int document_id = generator() % documents.size();
+            ASSERT(updated_server.MatchDocument(query, document_id) == readded_server.MatchDocument(query, document_id));
+            ASSERT(updated_server.GetWordFrequencies(document_id) == readded_server.GetWordFrequencies(document_id));
+        }
+    }
+}
+
+void TestBatchMatchesSingleQueries() {
+    for (int layout = 0; layout < 2; ++layout) {
+        IndexOptions options;
+        options.impact_ordered_postings = layout == 1;
+        SearchServer search_server("and"s, options);
+        std::mt19937 generator(9);
+        // Ids with a wide gap, w0 in most documents has enough postings to split groups into ranges
+        CorpusShape shape;
+        shape.document_count = 10000;
+        shape.vocabulary_size = 200;
+        shape.min_words = 2;
+        shape.max_words = 16;
+        shape.word_decay = 0.2;
+        shape.min_rating = 0;
+        shape.rating_count = 5;
+        shape.gap_from = 8000;
+        for (const TestDocument& document : MakeRandomDocuments(generator, shape)) {
+            search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+
+        std::vector<std::string> queries = { "w1 w2"s, "w2 w1 w1"s, ""s };
+        for (int i = 0; i < 300; ++i) {
+            if (generator() % 3 == 0) {
+                queries.push_back(queries[generator() % queries.size()]);
+                continue;
+            }
+            std::string query;
+            const int word_count = 1 + generator() % 4;
+            for (int j = 0; j < word_count; ++j) {
+                query += "w"s + std::to_string(generator() % 30) + " "s;
+            }
+            if (generator() % 4 == 0) {
+                query += "-w"s + std::to_string(generator() % 30) + " "s;
+            }
+            if (generator() % 10 == 0) {
+                query = "+w"s + std::to_string(generator() % 5) + " "s + query;
+            }
+            if (generator() % 10 == 0) {
+                query += "unknown and"s;
+            }
+            queries.push_back(query);
+        }
+
+        const std::vector<std::vector<Document>> batch_results = search_server.FindTopDocumentsBatch(queries);
+        ASSERT_EQUAL(batch_results.size(), queries.size());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            const std::vector<Document> expected = search_server.FindTopDocuments(queries[i]);
+            ASSERT_EQUAL_HINT(batch_results[i].size(), expected.size(), queries[i]);
+            for (size_t j = 0; j < expected.size(); ++j) {
+                ASSERT_EQUAL_HINT(batch_results[i][j].id, expected[j].id, queries[i]);
+                ASSERT_EQUAL_HINT(batch_results[i][j].relevance, expected[j].relevance, queries[i]);
+                ASSERT_EQUAL_HINT(batch_results[i][j].rating, expected[j].rating, queries[i]);
+            }
+        }
+    }
+    ASSERT(SearchServer("and"s).FindTopDocumentsBatch({ "w1"s }).at(0).empty());
+}
+
+}  // namespace
+
+
+void TestSearchServer() {
+    RUN_TEST(TestShardCoordinatorMatchesSingleServer);
+    RUN_TEST(TestMatchDocumentsMatchesMatchDocument);
+    RUN_TEST(TestStopWordSetMembership);
+    RUN_TEST(TestShardedServerMatchesSingleServer);
+    RUN_TEST(TestSearchWithinLimits);
+    RUN_TEST(TestFilterMatchesPredicate);
+    RUN_TEST(TestDocumentSlotMapMatchesStdMap);
+    RUN_TEST(TestSparseDocumentIdsUseDenseSlots);
+    RUN_TEST(TestCompactForwardIndexWordFrequencies);
+    RUN_TEST(TestLoadCorpusFromMappedFileAndStream);
+    RUN_TEST(TestLoadCorpusReportsLineNumbers);
+    RUN_TEST(TestLoadCorpusIndexesInFileOrder);
+    RUN_TEST(TestImpactOrderedPostingsMatchDefaultLayout);
+    RUN_TEST(TestSortDocumentsMatchesStableSort);
+    RUN_TEST(TestRequiredWordsMatchBruteForceIntersection);
+    RUN_TEST(TestInPlaceUpdatesMatchRemoveAndAdd);
+    RUN_TEST(TestBatchMatchesSingleQueries);
+}
@@ -0,0 +1,14 @@
+// Runs the unit tests of the search server. The shard test forks shard processes
+// and talks to them over a unix socket and a tcp socket on a port picked by the system.
+//
+// Build from search-server/:
+//   g++ -std=c++17 -O2 tests/search_server_tests.cpp $(ls *.cpp | grep -v '^main.cpp$') -o search_server_tests -ltbb -lpthread
+//
+// Built like the demo program, with this file in place of main.cpp
+
+#include "../test_example_functions.h"
+
+int main() {
+    TestSearchServer();
+    return 0;
+}
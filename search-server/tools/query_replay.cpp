@@ -0,0 +1,330 @@
+// Replays a recorded query log against a SearchServer loaded from a corpus file
+// and reports throughput and latency percentiles by operation.
+//
+// Query log format, one request per line:
+//   find TAB <query>                 FindTopDocuments(query)
+//   find_seq TAB <query>             FindTopDocuments(execution::seq, query)
+//   find_par TAB <query>             FindTopDocuments(execution::par, query)
+//   match TAB <document id> TAB <query>
+//   request TAB <query>              RequestQueue::AddFindRequest(query)
+//
+// Closed loop (--clients N): N clients send the next request as soon as the previous
+// one is answered. Open loop (--rate R): requests are due at a fixed rate of R per
+// second and latency is measured from the due time, so a stalled server is charged
+// for the requests queued behind it instead of hiding them (coordinated omission).
+//
+// Build from search-server/:
+//   g++ -std=c++17 -O2 tools/query_replay.cpp $(ls *.cpp | grep -v '^main.cpp$') -o query_replay -ltbb -lpthread
+//
+// Built like the demo program, with this file in place of main.cpp
+
+#include "../corpus_loader.h"
+#include "../request_queue.h"
+#include "../search_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <execution>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Operation {
+    FIND,
+    FIND_SEQ,
+    FIND_PAR,
+    MATCH,
+    REQUEST,
+};
+
+const size_t OPERATION_COUNT = 5;
+const std::string_view OPERATION_NAMES[OPERATION_COUNT] = { "find", "find_seq", "find_par", "match", "request" };
+
+struct LoggedQuery {
+    Operation operation = Operation::FIND;
+    int document_id = 0;
+    std::string text;
+};
+
+struct ReplayOptions {
+    std::string corpus_path;
+    std::string query_log_path;
+    std::string stop_words;
+    size_t client_count = 0;
+    double rate = 0.0;  // requests per second, 0 for the closed loop
+    size_t repeat_count = 1;
+    IndexOptions index_options;
+};
+
+struct Sample {
+    Operation operation;
+    Clock::duration latency;
+};
+
+void PrintUsage() {
+    std::cerr << "Usage: query_replay <corpus> <query log> [--clients N] [--rate R] [--repeat K]\n"
+                 "                    [--stop-words \"words\"] [--compact] [--impact]\n";
+}
+
+Operation ParseOperation(std::string_view name) {
+    for (size_t i = 0; i < OPERATION_COUNT; ++i) {
+        if (OPERATION_NAMES[i] == name) {
+            return static_cast<Operation>(i);
+        }
+    }
+    using namespace std::string_literals;
+    throw std::invalid_argument("Unknown operation "s + std::string(name));
+}
+
+std::vector<LoggedQuery> ReadQueryLog(const std::string& path) {
+    using namespace std::string_literals;
+    std::ifstream input(path);
+    if (!input) {
+        throw std::runtime_error("Cannot open query log "s + path);
+    }
+    std::vector<LoggedQuery> queries;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(input, line)) {
+        ++line_number;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        std::string_view rest = line;
+        const size_t tab_pos = rest.find('\t');
+        if (tab_pos == rest.npos) {
+            throw std::invalid_argument("Query log line "s + std::to_string(line_number) + ": missing query"s);
+        }
+        LoggedQuery query;
+        query.operation = ParseOperation(rest.substr(0, tab_pos));
+        rest.remove_prefix(tab_pos + 1);
+        if (query.operation == Operation::MATCH) {
+            const size_t id_end = rest.find('\t');
+            const auto [end, error] = std::from_chars(rest.data(), rest.data() + std::min(id_end, rest.size()),
+                                                      query.document_id);
+            if (id_end == rest.npos || error != std::errc() || end != rest.data() + id_end) {
+                throw std::invalid_argument("Query log line "s + std::to_string(line_number) + ": bad document id"s);
+            }
+            rest.remove_prefix(id_end + 1);
+        }
+        query.text = std::string(rest);
+        queries.push_back(std::move(query));
+    }
+    return queries;
+}
+
+ReplayOptions ParseOptions(int argc, char* argv[]) {
+    using namespace std::string_literals;
+    std::vector<std::string_view> args(argv + 1, argv + argc);
+    ReplayOptions options;
+    std::vector<std::string_view> positional;
+    for (size_t i = 0; i < args.size(); ++i) {
+        const auto next_value = [&] {
+            if (i + 1 == args.size()) {
+                throw std::invalid_argument("Missing value of "s + std::string(args[i]));
+            }
+            return std::string(args[++i]);
+        };
+        if (args[i] == "--clients") {
+            options.client_count = std::stoul(next_value());
+        }
+        else if (args[i] == "--rate") {
+            options.rate = std::stod(next_value());
+        }
+        else if (args[i] == "--repeat") {
+            options.repeat_count = std::stoul(next_value());
+        }
+        else if (args[i] == "--stop-words") {
+            options.stop_words = next_value();
+        }
+        else if (args[i] == "--compact") {
+            options.index_options.compact_forward_index = true;
+        }
+        else if (args[i] == "--impact") {
+            options.index_options.impact_ordered_postings = true;
+        }
+        else {
+            positional.push_back(args[i]);
+        }
+    }
+    if (positional.size() != 2 || options.rate < 0.0) {
+        throw std::invalid_argument("Wrong arguments"s);
+    }
+    options.corpus_path = std::string(positional[0]);
+    options.query_log_path = std::string(positional[1]);
+    if (options.client_count == 0) {
+        options.client_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return options;
+}
+
+void Execute(const SearchServer& search_server, RequestQueue& request_queue, const LoggedQuery& query) {
+    switch (query.operation) {
+    case Operation::FIND:
+        search_server.FindTopDocuments(query.text);
+        break;
+    case Operation::FIND_SEQ:
+        search_server.FindTopDocuments(std::execution::seq, query.text);
+        break;
+    case Operation::FIND_PAR:
+        search_server.FindTopDocuments(std::execution::par, query.text);
+        break;
+    case Operation::MATCH:
+        search_server.MatchDocument(query.text, query.document_id);
+        break;
+    case Operation::REQUEST:
+        request_queue.AddFindRequest(query.text);
+        break;
+    }
+}
+
+// Every client runs on its own thread with its own RequestQueue and takes
+// the next request from a shared counter. In the open loop a client first
+// waits for the due time of the request
+std::vector<Sample> Replay(const SearchServer& search_server, const std::vector<LoggedQuery>& queries,
+                           const ReplayOptions& options, Clock::duration& elapsed) {
+    const size_t request_count = queries.size() * options.repeat_count;
+    std::atomic<size_t> next_request = 0;
+    std::vector<std::vector<Sample>> client_samples(options.client_count);
+    std::vector<size_t> failure_counts(options.client_count, 0);
+
+    const Clock::time_point start_time = Clock::now();
+    std::vector<std::thread> clients;
+    for (size_t client = 0; client < options.client_count; ++client) {
+        clients.emplace_back([&, client] {
+            RequestQueue request_queue(search_server);
+            std::vector<Sample>& samples = client_samples[client];
+            for (size_t request = next_request++; request < request_count; request = next_request++) {
+                const LoggedQuery& query = queries[request % queries.size()];
+                Clock::time_point due_time = Clock::now();
+                if (options.rate > 0.0) {
+                    due_time = start_time + std::chrono::duration_cast<Clock::duration>(
+                        std::chrono::duration<double>(request / options.rate));
+                    std::this_thread::sleep_until(due_time);
+                }
+                try {
+                    Execute(search_server, request_queue, query);
+                }
+                catch (const std::exception&) {
+                    ++failure_counts[client];
+                }
+                samples.push_back({ query.operation, Clock::now() - due_time });
+            }
+        });
+    }
+    for (std::thread& client : clients) {
+        client.join();
+    }
+    elapsed = Clock::now() - start_time;
+
+    size_t failure_count = 0;
+    for (const size_t count : failure_counts) {
+        failure_count += count;
+    }
+    if (failure_count > 0) {
+        std::cerr << failure_count << " requests failed\n";
+    }
+
+    std::vector<Sample> samples;
+    samples.reserve(request_count);
+    for (const auto& client_part : client_samples) {
+        samples.insert(samples.end(), client_part.begin(), client_part.end());
+    }
+    return samples;
+}
+
+double GetPercentileMicroseconds(const std::vector<Clock::duration>& sorted_latencies, double percentile) {
+    const size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * sorted_latencies.size()));
+    const Clock::duration latency = sorted_latencies[std::max<size_t>(rank, 1) - 1];
+    return std::chrono::duration<double, std::micro>(latency).count();
+}
+
+void PrintReport(const std::vector<Sample>& samples, Clock::duration elapsed) {
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    std::cout << std::left << std::setw(10) << "operation" << std::right
+              << std::setw(10) << "count" << std::setw(12) << "qps"
+              << std::setw(12) << "p50 us" << std::setw(12) << "p99 us" << std::setw(12) << "p99.9 us" << '\n';
+
+    const auto print_row = [seconds] (std::string_view name, std::vector<Clock::duration>& latencies) {
+        if (latencies.empty()) {
+            return;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        std::cout << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << latencies.size()
+                  << std::setw(12) << latencies.size() / seconds
+                  << std::setw(12) << GetPercentileMicroseconds(latencies, 50.0)
+                  << std::setw(12) << GetPercentileMicroseconds(latencies, 99.0)
+                  << std::setw(12) << GetPercentileMicroseconds(latencies, 99.9) << '\n';
+    };
+
+    std::vector<Clock::duration> all_latencies;
+    for (size_t i = 0; i < OPERATION_COUNT; ++i) {
+        std::vector<Clock::duration> latencies;
+        for (const Sample& sample : samples) {
+            if (static_cast<size_t>(sample.operation) == i) {
+                latencies.push_back(sample.latency);
+            }
+        }
+        all_latencies.insert(all_latencies.end(), latencies.begin(), latencies.end());
+        print_row(OPERATION_NAMES[i], latencies);
+    }
+    print_row("total", all_latencies);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    ReplayOptions options;
+    try {
+        options = ParseOptions(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        PrintUsage();
+        return 1;
+    }
+
+    try {
+        SearchServer search_server(options.stop_words, options.index_options);
+        const Clock::time_point load_start = Clock::now();
+        const size_t document_count = LoadCorpus(search_server, options.corpus_path);
+        std::cerr << "Loaded " << document_count << " documents in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - load_start).count()
+                  << " ms\n";
+
+        const std::vector<LoggedQuery> queries = ReadQueryLog(options.query_log_path);
+        if (queries.empty()) {
+            std::cerr << "Query log is empty\n";
+            return 1;
+        }
+
+        Clock::duration elapsed{};
+        const std::vector<Sample> samples = Replay(search_server, queries, options, elapsed);
+        std::cout << (options.rate > 0.0 ? "open loop" : "closed loop") << ", " << options.client_count
+                  << " clients, " << samples.size() << " requests in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms\n";
+        PrintReport(samples, elapsed);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+// Runs one shard of a distributed search server or queries a set of shards.
+//
+//   search_shard serve <address> <corpus> [<shard index> <shard count>]
+//       Loads the corpus documents with id % shard count == shard index and
+//       serves them until the process is killed
+//   search_shard query <timeout ms> <address>...
+//       Reads one query per line from stdin and prints the merged top documents
+//
+// Addresses are "unix:<socket path>" or "tcp:<ipv4 address>:<port>", serve
+// accepts port 0 and prints the port picked. The corpus format is described
+// in corpus_loader.h. Build from search-server/:
+//   g++ -std=c++17 -O2 tools/search_shard.cpp $(ls *.cpp | grep -v '^main.cpp$') -o search_shard -ltbb -lpthread
+
+#include "../corpus_loader.h"
+#include "../search_server.h"
+#include "../shard_coordinator.h"
+#include "../shard_server.h"
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+void PrintUsage() {
+    std::cerr << "Usage: search_shard serve <address> <corpus> [<shard index> <shard count>]\n"
+                 "       search_shard query <timeout ms> <address>...\n";
+}
+
+size_t LoadShard(SearchServer& search_server, const std::string& path, size_t shard_index, size_t shard_count) {
+    using namespace std::string_literals;
+    std::ifstream input(path);
+    if (!input) {
+        throw std::runtime_error("Cannot open corpus "s + path);
+    }
+    size_t added_count = 0;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(input, line)) {
+        ++line_number;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        try {
+            const CorpusLine corpus_line = ParseCorpusLine(line);
+            if (uint64_t(corpus_line.id) % shard_count != shard_index) {
+                continue;
+            }
+            search_server.AddDocument(corpus_line.id, corpus_line.text, corpus_line.status, corpus_line.ratings);
+            ++added_count;
+        }
+        catch (const std::invalid_argument& e) {
+            throw std::invalid_argument("Corpus line "s + std::to_string(line_number) + ": "s + e.what());
+        }
+    }
+    return added_count;
+}
+
+int Serve(const std::vector<std::string>& args) {
+    if (args.size() != 2 && args.size() != 4) {
+        PrintUsage();
+        return 1;
+    }
+    size_t shard_index = 0;
+    size_t shard_count = 1;
+    if (args.size() == 4) {
+        shard_index = std::stoul(args[2]);
+        shard_count = std::stoul(args[3]);
+    }
+    if (shard_index >= shard_count) {
+        PrintUsage();
+        return 1;
+    }
+
+    SearchServer search_server(std::string{});
+    const size_t document_count = shard_count == 1
+        ? LoadCorpus(search_server, args[1])
+        : LoadShard(search_server, args[1], shard_index, shard_count);
+    ShardServer shard_server(search_server, args[0]);
+    // Shows the port chosen for a tcp address with port 0
+    std::cerr << "Serving " << document_count << " documents at " << shard_server.GetAddress() << '\n';
+    shard_server.Run();
+    return 0;
+}
+
+int Query(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        PrintUsage();
+        return 1;
+    }
+    const std::chrono::milliseconds timeout(std::stol(args[0]));
+    ShardCoordinator coordinator({ args.begin() + 1, args.end() }, timeout);
+
+    std::string query;
+    while (std::getline(std::cin, query)) {
+        try {
+            const CoordinatedSearchResult result = coordinator.FindTopDocuments(query);
+            for (const Document& document : result.documents) {
+                std::cout << document << '\n';
+            }
+            if (result.unavailable_shard_count > 0) {
+                std::cout << result.unavailable_shard_count << " shards unavailable\n";
+            }
+        }
+        catch (const std::invalid_argument& e) {
+            std::cout << e.what() << '\n';
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        PrintUsage();
+        return 1;
+    }
+    const std::string mode = argv[1];
+    const std::vector<std::string> args(argv + 2, argv + argc);
+    try {
+        if (mode == "serve") {
+            return Serve(args);
+        }
+        if (mode == "query") {
+            return Query(args);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    PrintUsage();
+    return 1;
+}